@@ -37,10 +37,113 @@ float non_lin_func(float parm) {
 	return a / b;
 }
 
+simd::float_4 non_lin_func(simd::float_4 parm) {
+	// Same as above, in float lanes
+	simd::float_4 x2 = parm * parm;
+	simd::float_4 a = parm * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2)));
+	simd::float_4 b = 135135.0f + x2 * (62370.0f + x2 * (3150.0f + x2 * 28.0f));
+	return simd::ifelse(parm > 4.97f, 1.0f, simd::ifelse(parm < -4.97f, -1.0f, a / b));
+}
+
 float non_lin_func2(float parm) {
 	return 2.0f * (exp(parm)-exp(-parm));
 }
 
+simd::float_4 non_lin_func2(simd::float_4 parm) {
+	return 4.0f * sinh_fast(parm);
+}
+
+simd::float_4 sinh_fast(simd::float_4 x) {
+	// Taylor series to x^9, within 3e-8 of sinh for |x| <= 1. Outside that it falls back to exp().
+	simd::float_4 x2 = x * x;
+	simd::float_4 y = x * (1.0f + x2 * (1.0f/6.0f + x2 * (1.0f/120.0f + x2 * (1.0f/5040.0f + x2 * (1.0f/362880.0f)))));
+	simd::float_4 outside = simd::fabs(x) > 1.0f;
+	if (simd::movemask(outside)) {
+		simd::float_4 e = simd::exp(x);
+		y = simd::ifelse(outside, 0.5f * (e - 1.0f / e), y);
+	}
+	return y;
+}
+
+simd::float_4 cosh_fast(simd::float_4 x) {
+	// Taylor series to x^10, within 3e-9 of cosh for |x| <= 1. Outside that it falls back to exp().
+	simd::float_4 x2 = x * x;
+	simd::float_4 y = 1.0f + x2 * (0.5f + x2 * (1.0f/24.0f + x2 * (1.0f/720.0f + x2 * (1.0f/40320.0f + x2 * (1.0f/3628800.0f)))));
+	simd::float_4 outside = simd::fabs(x) > 1.0f;
+	if (simd::movemask(outside)) {
+		simd::float_4 e = simd::exp(x);
+		y = simd::ifelse(outside, 0.5f * (e + 1.0f / e), y);
+	}
+	return y;
+}
+
+// Coefficients of a polyphase IIR half-band (elliptic, as in the HIIR library by Laurent de Soras).
+// transition is the width of the transition band relative to the high sample rate.
+void designHalfBandIIR(float* coefs, int count, double transition) {
+	double k = tan((1.0 - transition * 2.0) * M_PI / 4.0);
+	k *= k;
+	double kksqrt = pow(1.0 - k * k, 0.25);
+	double e = 0.5 * (1.0 - kksqrt) / (1.0 + kksqrt);
+	double e2 = e * e;
+	double e4 = e2 * e2;
+	double q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+	int order = count * 2 + 1;
+	for (int index = 0; index < count; index++) {
+		int c = index + 1;
+		double num = 0.0;
+		double term;
+		int i = 0;
+		double sign = 1.0;
+		do {
+			term = pow(q, i * (i + 1)) * sin((i * 2 + 1) * c * M_PI / order) * sign;
+			num += term;
+			sign = -sign;
+			i++;
+		} while (fabs(term) > 1e-100);
+		num *= pow(q, 0.25);
+		double den = 0.0;
+		i = 1;
+		sign = -1.0;
+		do {
+			term = pow(q, i * i) * cos(i * 2 * c * M_PI / order) * sign;
+			den += term;
+			sign = -sign;
+			i++;
+		} while (fabs(term) > 1e-100);
+		den += 0.5;
+		double ww = num / den;
+		double wwsq = ww * ww;
+		double x = sqrt((1.0 - wwsq * k) * (1.0 - wwsq / k)) / (1.0 + wwsq);
+		coefs[index] = (1.0 - x) / (1.0 + x);
+	}
+}
+
+// Kaiser windowed sinc half-band, only the nonzero taps of one side, nearest the center first.
+// They sum to 0.25 so both phases have unity gain at DC.
+void designHalfBandFIR(float* taps, int count, double beta) {
+	auto besselI0 = [](double x) {
+		double sum = 1.0;
+		double term = 1.0;
+		for (int i = 1; i < 30; i++) {
+			term *= (x / (2.0 * i)) * (x / (2.0 * i));
+			sum += term;
+		}
+		return sum;
+	};
+	double sum = 0.0;
+	for (int j = 1; j <= count; j++) {
+		double t = 2.0 * j - 1.0;// distance from center in high rate samples
+		double sinc = sin(M_PI * t / 2.0) / (M_PI * t / 2.0);
+		double r = t / (2.0 * count);
+		double window = besselI0(beta * sqrt(1.0 - r * r)) / besselI0(beta);
+		taps[j - 1] = 0.5 * sinc * window;
+		sum += taps[j - 1];
+	}
+	for (int j = 0; j < count; j++) {
+		taps[j] *= 0.25 / sum;
+	}
+}
+
 float slew(float input, float input_prev, float maxChangePerSec, float dt) {
 	float delta = input - input_prev;
 
@@ -90,6 +193,8 @@ void init(rack::Plugin *p) {
 	p->addModel(modelZod);
 	p->addModel(modelTriBand);
 	p->addModel(modelMixer6);
+	p->addModel(modelMixer6Expander);
+	p->addModel(modelMixer6Outputs);
 	p->addModel(modelNon);
 	p->addModel(modelFil);
 	p->addModel(modelNap);
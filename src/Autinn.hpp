@@ -180,9 +180,489 @@ px=mm*75.0/25.4=mm*2.95
 
 
 float non_lin_func(float parm);
+simd::float_4 non_lin_func(simd::float_4 parm);
 float non_lin_func2(float parm);//sinh
+simd::float_4 non_lin_func2(simd::float_4 parm);
+simd::float_4 sinh_fast(simd::float_4 x);
+simd::float_4 cosh_fast(simd::float_4 x);
 float slew(float input, float input_prev, float maxChangePerSec, float dt);
 
+////////////////////
+// shared dsp
+////////////////////
+
+// 4 biquads in SIMD lanes, unlike dsp::TBiquadFilter<simd::float_4> each lane has its own coefficients.
+// Coefficients are made by dsp::BiquadFilter, so a lane behaves exactly like a scalar dsp::BiquadFilter.
+struct BiquadFilter4 {
+	simd::float_4 b0 = 0.0f;
+	simd::float_4 b1 = 0.0f;
+	simd::float_4 b2 = 0.0f;
+	simd::float_4 a1 = 0.0f;
+	simd::float_4 a2 = 0.0f;
+	simd::float_4 x1 = 0.0f;
+	simd::float_4 x2 = 0.0f;
+	simd::float_4 y1 = 0.0f;
+	simd::float_4 y2 = 0.0f;
+
+	void reset() {
+		x1 = x2 = y1 = y2 = 0.0f;
+	}
+
+	void setParameters(int lane, dsp::BiquadFilter::Type type, float f, float Q, float V) {
+		dsp::BiquadFilter filter;
+		filter.setParameters(type, f, Q, V);
+		b0[lane] = filter.b[0];
+		b1[lane] = filter.b[1];
+		b2[lane] = filter.b[2];
+		a1[lane] = filter.a[0];
+		a2[lane] = filter.a[1];
+	}
+
+	simd::float_4 process(simd::float_4 in) {
+		simd::float_4 out = b0 * in + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+		x2 = x1;
+		x1 = in;
+		y2 = y1;
+		y1 = out;
+		return out;
+	}
+};
+
+// Windowed sinc up- and downsampling, T is float or simd::float_4 (4 voices in SIMD lanes).
+// Same kernels as dsp::Upsampler and dsp::Decimator, so a lane sounds exactly like the scalar ones.
+template <int OVERSAMPLE, int QUALITY, typename T>
+struct SincUpsampler {
+	T inBuffer[QUALITY];
+	float kernel[OVERSAMPLE * QUALITY];
+	int inIndex;
+
+	SincUpsampler(float cutoff = 0.9f) {
+		dsp::boxcarLowpassIR(kernel, OVERSAMPLE * QUALITY, cutoff * 0.5f / OVERSAMPLE);
+		dsp::blackmanHarrisWindow(kernel, OVERSAMPLE * QUALITY);
+		reset();
+	}
+
+	void reset() {
+		inIndex = 0;
+		for (int i = 0; i < QUALITY; i++) {
+			inBuffer[i] = 0.0f;
+		}
+	}
+
+	void process(T in, T* out) {
+		// zero-stuffed input, the gain makes up for the stuffed zeros
+		inBuffer[inIndex] = OVERSAMPLE * in;
+		inIndex = (inIndex + 1) % QUALITY;
+		for (int i = 0; i < OVERSAMPLE; i++) {
+			T y = 0.0f;
+			int index = inIndex;
+			for (int j = 0; j < QUALITY; j++) {
+				index = (index + QUALITY - 1) % QUALITY;
+				y += kernel[OVERSAMPLE * j + i] * inBuffer[index];
+			}
+			out[i] = y;
+		}
+	}
+};
+
+template <int OVERSAMPLE, int QUALITY, typename T>
+struct SincDecimator {
+	T inBuffer[OVERSAMPLE * QUALITY];
+	float kernel[OVERSAMPLE * QUALITY];
+	int inIndex;
+
+	SincDecimator(float cutoff = 0.9f) {
+		dsp::boxcarLowpassIR(kernel, OVERSAMPLE * QUALITY, cutoff * 0.5f / OVERSAMPLE);
+		dsp::blackmanHarrisWindow(kernel, OVERSAMPLE * QUALITY);
+		reset();
+	}
+
+	void reset() {
+		inIndex = 0;
+		for (int i = 0; i < OVERSAMPLE * QUALITY; i++) {
+			inBuffer[i] = 0.0f;
+		}
+	}
+
+	T process(const T* in) {
+		for (int i = 0; i < OVERSAMPLE; i++) {
+			inBuffer[inIndex + i] = in[i];
+		}
+		inIndex = (inIndex + OVERSAMPLE) % (OVERSAMPLE * QUALITY);
+		T out = 0.0f;
+		for (int i = 0; i < OVERSAMPLE * QUALITY; i++) {
+			int index = (inIndex - 1 - i + OVERSAMPLE * QUALITY) % (OVERSAMPLE * QUALITY);
+			out += kernel[i] * inBuffer[index];
+		}
+		return out;
+	}
+};
+
+void designHalfBandIIR(float* coefs, int count, double transition);
+void designHalfBandFIR(float* taps, int count, double beta);
+
+// 2x polyphase IIR half-band: each phase is a chain of first order allpasses, and their sum is the half-band.
+// Not linear phase, but only a couple of samples of delay.
+template <typename T>
+struct HalfBandIIR {
+	static const int COEFS = 8;
+	float coefs[COEFS];
+	T x_mem[COEFS];
+	T y_mem[COEFS];
+
+	HalfBandIIR() {
+		designHalfBandIIR(coefs, COEFS, 0.04);// flat to 0.24 of the high rate, 100 dB down from 0.27
+		reset();
+	}
+
+	void reset() {
+		for (int k = 0; k < COEFS; k++) {
+			x_mem[k] = 0.0f;
+			y_mem[k] = 0.0f;
+		}
+	}
+
+	T chain(int phase, T x) {
+		for (int k = phase; k < COEFS; k += 2) {
+			T y = (x - y_mem[k]) * coefs[k] + x_mem[k];
+			x_mem[k] = x;
+			y_mem[k] = y;
+			x = y;
+		}
+		return x;
+	}
+
+	void upsample(T in, T* out) {
+		out[0] = chain(0, in);
+		out[1] = chain(1, in);
+	}
+
+	T downsample(const T* in) {
+		return 0.5f * (chain(0, in[1]) + chain(1, in[0]));
+	}
+};
+
+// 2x polyphase FIR half-band, linear phase. Every other tap is zero, so one phase is a plain delay
+// and the other is a symmetric filter of TAPS pairs. The delay is TAPS-1/2 samples at the low rate.
+template <typename T>
+struct HalfBandFIR {
+	static const int TAPS = 80;
+	float taps[TAPS];
+	// histories of the low rate (or for downsampling, the odd and even high rate) samples, written twice so reads never wrap
+	T odd[4 * TAPS];
+	T even[4 * TAPS];
+	int pos;
+
+	HalfBandFIR() {
+		designHalfBandFIR(taps, TAPS, 10.0);// within 0.0001 dB to 0.24 of the high rate, 105 dB down from 0.27
+		reset();
+	}
+
+	void reset() {
+		pos = 0;
+		for (int i = 0; i < 4 * TAPS; i++) {
+			odd[i] = 0.0f;
+			even[i] = 0.0f;
+		}
+	}
+
+	// sum of the tap pairs around the center, p is the newest sample
+	T convolve(const T* history, int p) {
+		T y = 0.0f;
+		for (int j = 1; j <= TAPS; j++) {
+			y += taps[j - 1] * (history[p - TAPS + j] + history[p - TAPS - j + 1]);
+		}
+		return y;
+	}
+
+	void upsample(T in, T* out) {
+		pos = (pos + 1) % (2 * TAPS);
+		odd[pos] = odd[pos + 2 * TAPS] = in;
+		int p = pos + 2 * TAPS;
+		out[0] = 2.0f * convolve(odd, p);
+		out[1] = odd[p - TAPS + 1];
+	}
+
+	T downsample(const T* in) {
+		pos = (pos + 1) % (2 * TAPS);
+		even[pos] = even[pos + 2 * TAPS] = in[0];
+		odd[pos] = odd[pos + 2 * TAPS] = in[1];
+		int p = pos + 2 * TAPS;
+		return 0.5f * even[p - TAPS + 1] + convolve(odd, p);
+	}
+};
+
+enum ResamplerQuality {
+	RESAMPLER_STANDARD,// windowed sinc, what the modules always used
+	RESAMPLER_LOW_LATENCY,// IIR half-bands
+	RESAMPLER_HIGH,// long FIR half-bands
+	NUM_RESAMPLER_QUALITIES
+};
+
+constexpr int resamplerStages(int oversample) {
+	return oversample <= 1 ? 0 : 1 + resamplerStages(oversample / 2);
+}
+
+// Up- and downsampling by OVERSAMPLE (a power of 2) with the quality picked per instance.
+// The half-band tiers run one 2x stage per octave. QUALITY is the length of the standard sinc kernel.
+// setQuality() can be called from the UI thread, the switch and the reset of the filters happen in the audio thread.
+template <int OVERSAMPLE, int QUALITY, typename T>
+struct Resampler {
+	static_assert((OVERSAMPLE & (OVERSAMPLE - 1)) == 0, "OVERSAMPLE must be a power of 2");
+	static const int STAGES = resamplerStages(OVERSAMPLE);
+	int quality = RESAMPLER_STANDARD;
+	int active = RESAMPLER_STANDARD;
+
+	SincUpsampler<OVERSAMPLE, QUALITY, T> sincUp;
+	SincDecimator<OVERSAMPLE, QUALITY, T> sincDown;
+	HalfBandIIR<T> iirUp[STAGES];
+	HalfBandIIR<T> iirDown[STAGES];
+	HalfBandFIR<T> firUp[STAGES];
+	HalfBandFIR<T> firDown[STAGES];
+
+	void setQuality(int q) {
+		quality = q;
+	}
+
+	void reset() {
+		sincUp.reset();
+		sincDown.reset();
+		for (int s = 0; s < STAGES; s++) {
+			iirUp[s].reset();
+			iirDown[s].reset();
+			firUp[s].reset();
+			firDown[s].reset();
+		}
+	}
+
+	void sync() {
+		if (active != quality) {
+			reset();
+			active = quality;
+		}
+	}
+
+	template <typename STAGE>
+	static void upsampleStages(STAGE* stages, T in, T* out) {
+		T low[OVERSAMPLE];
+		out[0] = in;
+		for (int s = 0, n = 1; s < STAGES; s++, n *= 2) {
+			for (int i = 0; i < n; i++) {
+				low[i] = out[i];
+			}
+			for (int i = 0; i < n; i++) {
+				stages[s].upsample(low[i], &out[2 * i]);
+			}
+		}
+	}
+
+	template <typename STAGE>
+	static T downsampleStages(STAGE* stages, const T* in) {
+		T buf[OVERSAMPLE];
+		for (int i = 0; i < OVERSAMPLE; i++) {
+			buf[i] = in[i];
+		}
+		for (int s = STAGES - 1, n = OVERSAMPLE / 2; s >= 0; s--, n /= 2) {
+			for (int i = 0; i < n; i++) {
+				buf[i] = stages[s].downsample(&buf[2 * i]);
+			}
+		}
+		return buf[0];
+	}
+
+	void upsample(T in, T* out) {
+		sync();
+		if (active == RESAMPLER_LOW_LATENCY) {
+			upsampleStages(iirUp, in, out);
+		} else if (active == RESAMPLER_HIGH) {
+			upsampleStages(firUp, in, out);
+		} else {
+			sincUp.process(in, out);
+		}
+	}
+
+	T downsample(const T* in) {
+		sync();
+		if (active == RESAMPLER_LOW_LATENCY) {
+			return downsampleStages(iirDown, in);
+		} else if (active == RESAMPLER_HIGH) {
+			return downsampleStages(firDown, in);
+		}
+		return sincDown.process(in);
+	}
+};
+
+// Context menu item for modules that have resamplerQuality and setResamplerQuality().
+template <class MODULE>
+struct ResamplerMenuItem : MenuItem {
+	MODULE* _module;
+	int _quality;
+
+	ResamplerMenuItem(MODULE* module, const char* label, int quality)
+	: _module(module), _quality(quality)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->setResamplerQuality(_quality);
+	}
+
+	void step() override {
+		rightText = _module->resamplerQuality == _quality ? "✔" : "";
+	}
+};
+
+template <class MODULE>
+void appendResamplerMenu(Menu* menu, MODULE* module) {
+	menu->addChild(new MenuLabel());
+	menu->addChild(new ResamplerMenuItem<MODULE>(module, "Resampler: standard", RESAMPLER_STANDARD));
+	menu->addChild(new ResamplerMenuItem<MODULE>(module, "Resampler: low latency (IIR)", RESAMPLER_LOW_LATENCY));
+	menu->addChild(new ResamplerMenuItem<MODULE>(module, "Resampler: high quality (FIR)", RESAMPLER_HIGH));
+}
+
+// Base for the mono modules that run COUNT float resamplers and have no other state to save.
+// It keeps the quality of the resamplers, saves it, resets it, and the widget below offers it in the context menu.
+template <int OVERSAMPLE, int QUALITY, int COUNT = 1>
+struct ResampledModule : Module {
+	Resampler<OVERSAMPLE, QUALITY, float> resampler[COUNT];
+	int resamplerQuality = RESAMPLER_STANDARD;
+
+	void setResamplerQuality(int quality) {
+		resamplerQuality = quality;
+		for (int i = 0; i < COUNT; i++) {
+			resampler[i].setQuality(quality);
+		}
+	}
+
+	void onReset(const ResetEvent& e) override {
+		this->setResamplerQuality(RESAMPLER_STANDARD);
+		Module::onReset(e);
+	}
+
+	json_t *dataToJson() override {
+		json_t *root = json_object();
+		json_object_set_new(root, "resampler", json_integer(resamplerQuality));
+		return root;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *ext = json_object_get(rootJ, "resampler");
+		if (ext) {
+			this->setResamplerQuality(clamp((int) json_integer_value(ext), 0, NUM_RESAMPLER_QUALITIES - 1));
+		}
+	}
+};
+
+template <class MODULE>
+struct ResampledModuleWidget : ModuleWidget {
+	void appendContextMenu(Menu* menu) override {
+		MODULE* a = dynamic_cast<MODULE*>(module);
+		assert(a);
+
+		appendResamplerMenu(menu, a);
+	}
+};
+
+static const float LADDER_V_T = 2.0f * 0.026f;// 2x thermal voltage of the ladder transistors
+
+// 4-pole transistor ladder low-pass, used by Bass and Flora. Lane type T is float or simd::float_4.
+// Feedback has a unit and a half delay to get phase shift close to 180 deg at cutoff.
+// comp adds input to the feedback path, to make passband gain not decrease too much when turning up resonance.
+template <typename T>
+struct Ladder {
+	T y_a = 0.0f;
+	T y_b = 0.0f;
+	T y_c = 0.0f;
+	T y_d = 0.0f;
+	T y_d_prev = 0.0f;
+	T W_a = 0.0f;
+	T W_b = 0.0f;
+	T W_c = 0.0f;
+
+	void reset() {
+		y_a = y_b = y_c = y_d = y_d_prev = 0.0f;
+		W_a = W_b = W_c = 0.0f;
+	}
+
+	// Runs OVERSAMPLE steps. g1 tunes the first stage, g the other three.
+	template <int OVERSAMPLE>
+	void process(const T* in, T* out, T g1, T g, T feedback, T comp) {
+		for (int i = 0; i < OVERSAMPLE; i++) {
+			// x is the voltage over the capacitor in the first stage:
+			T x = in[i] - feedback * (y_d + y_d_prev - comp * in[i]);
+			// 1st transistor stage:
+			y_a = y_a + g1 * (non_lin_func(x / LADDER_V_T) - W_a);
+			T W_a_new = non_lin_func(y_a / LADDER_V_T);
+			// 2nd transistor stage:
+			y_b = y_b + g * (W_a_new - W_b);
+			T W_b_new = non_lin_func(y_b / LADDER_V_T);
+			// 3rd transistor stage:
+			y_c = y_c + g * (W_b_new - W_c);
+			T W_c_new = non_lin_func(y_c / LADDER_V_T);
+			// 4th transistor stage:
+			y_d_prev = y_d;
+			y_d = y_d + g * (W_c_new - non_lin_func(y_d / LADDER_V_T));
+
+			W_a = W_a_new;
+			W_b = W_b_new;
+			W_c = W_c_new;
+			out[i] = y_d;
+		}
+	}
+};
+
+// Random numbers for one module instance, so modules do not share the global rand() state.
+// The seed is saved in the patch, loading it makes the module replay the same random choices.
+struct SeededRandom {
+	random::Xoroshiro128Plus generator;
+	uint64_t seed = 0;
+
+	SeededRandom() {
+		setSeed(random::u64());
+	}
+
+	void setSeed(uint64_t s) {
+		seed = s;
+		generator.seed(s, s ^ 0x9e3779b97f4a7c15ULL);
+	}
+
+	// 0 to 1, not including 1.
+	float uniform() {
+		return float(generator() >> 40) / 16777216.0f;
+	}
+
+	// 0 to n-1.
+	int below(int n) {
+		return int(generator() % uint64_t(n));
+	}
+
+	// min to max, both included.
+	int between(int min, int max) {
+		return min + below(max - min + 1);
+	}
+
+	json_t *toJson() {
+		return json_integer((json_int_t) seed);
+	}
+
+	void fromJson(json_t *seedJ) {
+		if (seedJ) {
+			setSeed((uint64_t) json_integer_value(seedJ));
+		}
+	}
+};
+
+// Sent from a Melody to a Bass placed to its right, so the sequence plays without cables.
+// Refreshed every sample, so gate edges arrive with the same fixed one sample delay as the expander flip.
+struct MelodyBassMessage {
+	float pitch = 0.0f;// 1V/Oct of the current note, the target if gliding
+	float glideTime = 0.0f;// seconds the glide into this note should take
+	bool gate = false;// stays high into the next note if that note glides, like the 303 sequencer ties slides
+	bool accent = false;
+	bool glide = false;
+};
+
 ////////////////////
 // module widgets
 ////////////////////
@@ -209,6 +689,8 @@ extern Model *modelCVConverter;
 extern Model *modelZod;
 extern Model *modelTriBand;
 extern Model *modelMixer6;
+extern Model *modelMixer6Expander;
+extern Model *modelMixer6Outputs;
 extern Model *modelNon;
 extern Model *modelFil;
 extern Model *modelNap;
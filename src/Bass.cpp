@@ -50,9 +50,96 @@
 #define INPUT_TO_CAPACITOR 0.05f
 #define VCV_TO_MOOG 0.18f
 #define EXPECTED_PEAK_INPUT 7.0f // Do not input larger OSC tones, or accented notes might start hard clipping.
+#define OSC_INTERNAL_VOLT 5.0f // Peak of the internal oscillator, same as VCV oscillators.
+#define GLIDE_TIME 0.060f // 303 slide takes about 60ms, reached when gate is held over into next note.
 
 static const int oversample2 = 2;
 static const int oversample4 = 4;
+static const int bass_env_refresh = 32;// samples between anchoring the curved accent decays to their exact curve
+static const int bass_light_rate = 64;// samples between light updates
+
+// One envelope segment as a recurrence, each sample: level = level * mul + add, then add += slope.
+// Linear segments only use add, exponential ones only mul, the quadratic accent attack ramps add.
+// Coefficients are set when a segment starts, the step itself has no branches so T can also be simd::float_4.
+template <typename T>
+struct EnvelopeSegment {
+	T level;
+	T mul = 1.0f;
+	T add = 0.0f;
+	T slope = 0.0f;
+
+	EnvelopeSegment(T start) : level(start) {}
+
+	void setLinear(T step) {
+		mul = 1.0f;
+		add = step;
+		slope = 0.0f;
+	}
+
+	void setExponential(T factor) {
+		mul = factor;
+		add = 0.0f;
+		slope = 0.0f;
+	}
+
+	// The next process() returns base + height * (1-(1-n/steps)^2) and continues along that curve.
+	void setQuadratic(T base, T height, T n, T steps) {
+		T rest = 1.0f - (n - 1.0f) / steps;
+		level = base + height * (1.0f - rest * rest);
+		mul = 1.0f;
+		add = height * (2.0f / steps - (2.0f * n - 1.0f) / (steps * steps));
+		slope = -2.0f * height / (steps * steps);
+	}
+
+	T process() {
+		level = level * mul + add;
+		add += slope;
+		return level;
+	}
+};
+
+enum BassOscillatorShape {
+	OSC_EXTERNAL,
+	OSC_SAW,
+	OSC_SQUARE,
+	NUM_OSC_SHAPES
+};
+
+// Band-limited saw/square for the internal oscillator, run at the oversampled rate inside acid_filter so it never needs upsampling.
+// The steps are smoothed with a 2 sample polynomial residual (PolyBLEP), what aliasing remains is taken by the decimator.
+struct BassOscillator {
+	float phase = 0.0f;
+
+	static float polyBlep(float t, float dt) {
+		if (t < dt) {
+			t /= dt;
+			return t + t - t * t - 1.0f;
+		} else if (t > 1.0f - dt) {
+			t = (t - 1.0f) / dt;
+			return t * t + t + t + 1.0f;
+		}
+		return 0.0f;
+	}
+
+	// Fills OVERSAMPLE samples in range +-1. dt is frequency divided by the oversampled rate.
+	template <int OVERSAMPLE>
+	void process(float* out, float dt, bool square) {
+		for (int i = 0; i < OVERSAMPLE; i++) {
+			float saw = 2.0f * phase - 1.0f - polyBlep(phase, dt);
+			if (square) {
+				// Difference of two saws half a period apart is a square.
+				float half = phase < 0.5f ? phase + 0.5f : phase - 0.5f;
+				out[i] = saw - (2.0f * half - 1.0f - polyBlep(half, dt));
+			} else {
+				out[i] = saw;
+			}
+			phase += dt;
+			if (phase >= 1.0f) {
+				phase -= 1.0f;
+			}
+		}
+	}
+};
 
 struct Bass : Module {
 	enum ParamIds {
@@ -100,37 +187,18 @@ struct Bass : Module {
 		NUM_LIGHTS
 	};
 
-	float V_t = 0.026f*2.0f;
-	float x = 0.0f;
+	float V_t = LADDER_V_T;
 	float Gres = 1.0f;
 	float input_cutoff = 0.0f;
 	float F_c = 0.0f;
 	float F_s = 0.0f;
 	float g = 0.0f; // tuning parameter
-	float y_a = 0.0f;
-	float y_b = 0.0f;
-	float y_c = 0.0f;
-	float y_d = 0.0f;
-	float W_a = 0.0f;
-	float W_b = 0.0f;
-	float W_c = 0.0f;
-
-	float y_a_prev = 0.0f;
-	float y_b_prev = 0.0f;
-	float y_c_prev = 0.0f;
-	float y_d_prev = 0.0f;
-	float y_d_prev_prev = 0.0f;
-
-	float W_a_prev = 0.0f;
-	float W_b_prev = 0.0f;
-	float W_c_prev = 0.0f;
+	Ladder<float> ladder;
 
 	//dsp::Upsampler<oversample, 8> upsampler = dsp::Upsampler<oversample, 8>(0.9f);
 	//dsp::Decimator<oversample, 8> decimator = dsp::Decimator<oversample, 8>(0.9f);
-	dsp::Upsampler<oversample2, 10> upsampler2;
-	dsp::Decimator<oversample2, 10> decimator2;
-	dsp::Upsampler<oversample4, 10> upsampler4;
-	dsp::Decimator<oversample4, 10> decimator4;
+	Resampler<oversample2, 10, float> resampler2;
+	Resampler<oversample4, 10, float> resampler4;
 
 	bool gate_prev = false;
 	float minimum = 0.0001f;
@@ -139,15 +207,13 @@ struct Bass : Module {
 	unsigned number_vca = 1;
 	unsigned mode_vca = 3;
 	unsigned target_vca = 0;
-	float current_vca = minimum;
-	float factor_vca = 0.0f;
+	EnvelopeSegment<float> vca = EnvelopeSegment<float>(minimum);
 
 	int number_cutoff = 1;//must not be unsigned as used in minus operation where it might get below 0
 	unsigned mode_cutoff = 3;
 	int target_cutoff = 0;
-	float current_cutoff = minimum;
-	float factor_cutoff = 0.0f;
-	float cutoff_env_prev = 0.0f;
+	EnvelopeSegment<float> vcf = EnvelopeSegment<float>(minimum);
+	int light_step = 0;
 
 	dsp::SchmittTrigger schmittGate;
 	//dsp::SchmittTrigger schmittAccent;
@@ -160,10 +226,23 @@ struct Bass : Module {
 	// Json saved options ==============
 	float priority = 1.0f;// If 1.0f then will compensate for passband lowering at high resonances. If 0.0f then its just the raw filter.
 	int current_oversample = 2;// 2 for minimal anti-aliasing or 4 for better if you can spare the CPU time.
+	int resamplerQuality = RESAMPLER_STANDARD;
+	int oscillatorShape = OSC_EXTERNAL;// Internal oscillators use OSC input as 1V/Oct.
 	bool tunedResonance = false;// If true then resonance power will be tuned to equal power no matter the cutoff. However for this module it sounds best to have this false.
 	bool firstPoleOneOctHigher = false;// For more accurate physical sim of TB-303 filter. However a 24dB transistor filter sounds better than what 303 had, so keeping it at false.
 	// =================================
 	
+	// From a Melody on the left, instead of gate and accent cables:
+	MelodyBassMessage leftMessages[2];
+	bool melodyLinked = false;
+	float melodyPitch = 0.0f;
+	float melodyGlideTime = 0.0f;
+	bool melodyGlide = false;
+
+	BassOscillator oscillator;
+	float osc_freq = 0.0f;
+	float glide_pitch = 0.0f;// 1V/Oct after the slide
+
 	float accentAttackBase = 0.0f;
 	float accentAttackPeak = 0.0f;
 
@@ -178,6 +257,8 @@ struct Bass : Module {
 	Bass() {
 		//configParam (int paramId, float minValue, float maxValue, float defaultValue, string label="", string unit="", float displayBase=0.f, float displayMultiplier=1.f, float displayOffset=0.f)
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+		leftExpander.producerMessage = &leftMessages[0];
+		leftExpander.consumerMessage = &leftMessages[1];
 		configParam(Bass::CUTOFF_PARAM, 0.0f, 1.0f, 0.25f, "Cutoff"," Hz",CUTOFF_KNOB_MAX/CUTOFF_KNOB_MIN, CUTOFF_KNOB_MIN);
 		configParam(Bass::RESONANCE_PARAM, 0.0f, RESONANCE_MAX, 0.85f, "Resonance", "%", 0.0f, 100.0f);
 		configParam(Bass::ENV_DECAY_PARAM, DECAY_VCF_MIN, DECAY_VCF_MAX, (DECAY_VCF_MIN+DECAY_VCF_MAX)*0.5f, "Decay", " ms", 0.0f, 1000.0f);
@@ -197,7 +278,7 @@ struct Bass : Module {
 
 		configInput(Bass::NOTE_GATE_INPUT, "Gate/Trigger");
 		configInput(Bass::ACCENT_GATE_INPUT, "Accent Gate");
-		configInput(Bass::OSC_INPUT, "Oscillator tone");
+		configInput(Bass::OSC_INPUT, "Oscillator tone (1V/Oct for internal oscillator)");
 		configInput(Bass::CV_CUTOFF_INPUT, "Cutoff CV");
 		configInput(Bass::CV_RESONANCE_INPUT, "Resonance CV");
 		configInput(Bass::CV_DECAY_INPUT, "Decay CV");
@@ -219,10 +300,31 @@ struct Bass : Module {
 		configLight(Bass::GAIN_LIGHT, "Warning that oscillator input has too big magnitude (7+ Voltage)");
 	}
 
-	float vca_env(bool gate,float note, float resonance,float knob_accent);
-	float vca_env_acc(bool gate,float note, float resonance,float knob_accent);
-	float filter_env(bool gate,float note,float decay_cutoff_time, float accent, float r, float knob_accent);
-	float acid_filter(float in, float r, float cutoff, int oversample_protected);
+	float vca_env(bool gate,float note, float resonance,float knob_accent, float dt);
+	float vca_env_acc(bool gate,float note, float resonance,float knob_accent, float dt);
+	float filter_env(bool gate,float note,float decay_cutoff_time, float accent, float r, float knob_accent, float dt);
+	float accentDecayCurve(float fraction, float power);
+	float accentDecay(EnvelopeSegment<float>& env, int number, int target, float peak, float power);
+	template <int OVERSAMPLE>
+	float acid_filter(float in, float r, float cutoff, Resampler<OVERSAMPLE, 10, float>& resampler);
+	float acid_filter2(float in, float r, float cutoff) {
+		return this->acid_filter<oversample2>(in, r, cutoff, resampler2);
+	}
+	float acid_filter4(float in, float r, float cutoff) {
+		return this->acid_filter<oversample4>(in, r, cutoff, resampler4);
+	}
+	float (Bass::*acid_filter_func)(float in, float r, float cutoff) = &Bass::acid_filter2;// chosen once by setOversample() instead of every sample
+
+	void setOversample(int os) {
+		current_oversample = os;
+		acid_filter_func = os == oversample4 ? &Bass::acid_filter4 : &Bass::acid_filter2;
+	}
+
+	void setResamplerQuality(int quality) {
+		resamplerQuality = quality;
+		resampler2.setQuality(quality);
+		resampler4.setQuality(quality);
+	}
 	float attackCurve(float x, unsigned target);
 	float accentAttackCurve(float x);
 	float accentAttackCurveInverse(float y);
@@ -231,11 +333,14 @@ struct Bass : Module {
 	void process(const ProcessArgs &args) override;
 	void vca_lights(float attack, float sustain, float decay, float end);
 	void vcf_lights(float attack, float sustain, float decay, float end);
+	void env_lights();
 
 	json_t *dataToJson() override {
 		json_t *root = json_object();
 		json_object_set_new(root, "gateInput", json_boolean(gateInput));
 		json_object_set_new(root, "oversample", json_integer(current_oversample));
+		json_object_set_new(root, "resampler", json_integer(resamplerQuality));
+		json_object_set_new(root, "oscillator", json_integer(oscillatorShape));
 		//json_object_set_new(root, "Gcomp", json_real((double) priority));
 		return root;
 	}
@@ -246,10 +351,19 @@ struct Bass : Module {
 			gateInput = json_boolean_value(ext);
 		json_t *ext3 = json_object_get(rootJ, "oversample");
 		if (ext3) {
-			current_oversample = json_integer_value(ext3);
-			if (current_oversample != 2 and current_oversample != 4) {
-				current_oversample = 4;
+			int os = json_integer_value(ext3);
+			if (os != 2 and os != 4) {
+				os = 4;
 			}
+			this->setOversample(os);
+		}
+		json_t *ext4 = json_object_get(rootJ, "resampler");
+		if (ext4) {
+			this->setResamplerQuality(clamp((int) json_integer_value(ext4), 0, NUM_RESAMPLER_QUALITIES - 1));
+		}
+		json_t *ext5 = json_object_get(rootJ, "oscillator");
+		if (ext5) {
+			oscillatorShape = clamp((int) json_integer_value(ext5), 0, NUM_OSC_SHAPES - 1);
 		}
 		//json_t *ext2 = json_object_get(rootJ, "Gcomp");
 		//if (ext2)
@@ -259,6 +373,8 @@ struct Bass : Module {
 	void onReset(const ResetEvent& e) override {
 		priority = 1.0f;
 		gateInput = true;
+		oscillatorShape = OSC_EXTERNAL;
+		this->setResamplerQuality(RESAMPLER_STANDARD);
 		Module::onReset(e);
 	}
 
@@ -336,7 +452,6 @@ void Bass::process(const ProcessArgs &args) {
 	if (!outputs[BASS_OUTPUT].isConnected()) {
 		return;
 	}
-	int oversample_protected = current_oversample;// to be sure its not modified from another thread inside step.
 
 	
 
@@ -348,6 +463,16 @@ void Bass::process(const ProcessArgs &args) {
 	float knob_env_decay = clamp(params[ENV_DECAY_PARAM].getValue()+inputs[CV_DECAY_INPUT].getVoltage()*params[CV_DECAY_PARAM].getValue(),DECAY_VCF_MIN,DECAY_VCF_MAX);
 	float accent = clamp(inputs[ACCENT_GATE_INPUT].getVoltage(),0.0f,1.0f);
 	float note = inputs[NOTE_GATE_INPUT].getVoltage();
+	melodyLinked = leftExpander.module && leftExpander.module->model == modelMelody;
+	if (melodyLinked) {
+		// A Melody to the left plays the Bass. Its gate and accent replace the cables, so the envelopes start on the same sample as its notes.
+		MelodyBassMessage *fromMelody = (MelodyBassMessage*) leftExpander.consumerMessage;
+		note = fromMelody->gate ? 10.0f : 0.0f;
+		accent = fromMelody->accent ? 1.0f : 0.0f;
+		melodyPitch = fromMelody->pitch;
+		melodyGlideTime = fromMelody->glideTime;
+		melodyGlide = fromMelody->glide;
+	}
 
 	
 
@@ -364,11 +489,10 @@ void Bass::process(const ProcessArgs &args) {
 		accentBool = accent >= 1.0f;
 		//std::cout <<     "       ACCENT CHANGED "+std::to_string(accentBool)+"\n";
 	}
-	lights[E_LIGHT].value = accentBool;
 
 	//float accent_envelope = this->accent_env(gate, note, accent, knob_accent);
 
-	float cutoff_env_norm = this->filter_env(gate, note, knob_env_decay, accent, clamp(resonance, 0.0f, 1.0f), knob_accent);//params[DECAY3_PARAM].getValue()
+	float cutoff_env_norm = this->filter_env(gate, note, knob_env_decay, accent, clamp(resonance, 0.0f, 1.0f), knob_accent, args.sampleTime);//params[DECAY3_PARAM].getValue()
 	
 
 	float vca_env;
@@ -378,10 +502,10 @@ void Bass::process(const ProcessArgs &args) {
 	if (accentBool) {
 		//vca_env_sum = (vca_env+accent_envelope*ACCENT_ENVELOPE_VCA_OFFSET)/(1.0f+ACCENT_ENVELOPE_VCA_OFFSET);
 		//std::cout << "Branch accent\n";
-		vca_env = this->vca_env_acc(gate, note, clamp(resonance,0.0f,1.0f), knob_accent);
+		vca_env = this->vca_env_acc(gate, note, clamp(resonance,0.0f,1.0f), knob_accent, args.sampleTime);
 	} else {
 		//std::cout << "Branch normal\n";
-		vca_env = this->vca_env(gate, note, clamp(resonance,0.0f,1.0f), knob_accent);//knob_env_decay
+		vca_env = this->vca_env(gate, note, clamp(resonance,0.0f,1.0f), knob_accent, args.sampleTime);//knob_env_decay
 	}
 
 	float cutoff_setting = this->toExp(knob_cutoff, CUTOFF_KNOB_MIN, CUTOFF_KNOB_MAX);
@@ -392,9 +516,22 @@ void Bass::process(const ProcessArgs &args) {
 	
 	float cutoff_hz = cutoff_setting+cutoff_env_Hz;
 
+	if (oscillatorShape != OSC_EXTERNAL) {
+		float pitch = melodyLinked ? melodyPitch : osc;
+		if (note >= 1.0f && note_prev >= 1.0f) {
+			// Gate held into a new note slides to it, like the 303. A new gate jumps straight to the pitch.
+			float glide_time = melodyLinked && melodyGlide && melodyGlideTime > 0.0f ? melodyGlideTime : GLIDE_TIME;
+			glide_pitch += (pitch - glide_pitch) * (1.0f - exp(-3.0f * args.sampleTime / glide_time));
+		} else {
+			glide_pitch = pitch;
+		}
+		osc_freq = dsp::FREQ_C4 * powf(2.0f, clamp(glide_pitch, -5.0f, 5.0f));
+		osc = 0.0f;// for the gain light
+	}
+
 	cutoff_hz = clamp(cutoff_hz, CUTOFF_MIN, CUTOFF_MAX);
 
-	float out = this->acid_filter(osc, resonance, cutoff_hz, oversample_protected);
+	float out = (this->*acid_filter_func)(osc, resonance, cutoff_hz);
 	outputs[BASS_OUTPUT].setVoltage(vca_env*out, 0);//Audio output    //this->non_lin_func(vca*out/SATURATION_VOLT)*SATURATION_VOLT;
 	//outputs[BASS_OUTPUT].setVoltage(vca_env, 1);//VCA Envelope output (0V to 1.6V)
 	//outputs[BASS_OUTPUT].setVoltage(cutoff_env_norm-CUTOFF_ENVELOPE_BIAS, 2);//Normalized VCF cutoff envelope output (-0.31 to 3V)
@@ -427,7 +564,11 @@ void Bass::process(const ProcessArgs &args) {
 	gate_prev = gate;
 	note_prev = note;
 	
-	
+	light_step++;
+	if (light_step >= bass_light_rate) {
+		light_step = 0;
+		this->env_lights();
+	}
 	lights[GAIN_LIGHT].value = clamp(fabs(osc)-EXPECTED_PEAK_INPUT,0.0f,1.0f)*1.0f;//OSC input has too much gain. (7V+)
 }
 
@@ -478,10 +619,7 @@ float Bass::accent_env(bool gate, float note, bool accent, float knob_accent) {
 	return knob_accent*clamp(value, 0.0f, 1.0f);
 }
 
-float Bass::vca_env(bool gate, float note,  float resonance, float knob_accent) {
-	float dt = APP->engine->getSampleTime();
-	float level = 0.0f;
-
+float Bass::vca_env(bool gate, float note,  float resonance, float knob_accent, float dt) {
 	number_vca += 1; // steps progress counter
 	//std::cout <<     "NrmMode "+std::to_string(mode_vca)+" Number "+std::to_string(number_vca)+" Target "+std::to_string(target_vca)+"\n";
 	if (gate && !gate_prev) {
@@ -490,12 +628,12 @@ float Bass::vca_env(bool gate, float note,  float resonance, float knob_accent)
 		
 		// linear attack from previous level, to avoid clicking
 		target_vca = unsigned(ATTACK_VCA/dt);// How many steps to get amp to 1.0
-		factor_vca = (1.0f-current_vca)/float(target_vca);// How much to increase amp each step until 1.0 is reached (offset)
+		vca.setLinear((1.0f-vca.level)/float(target_vca));// How much to increase amp each step until 1.0 is reached (offset)
 	} else if (gateInput && mode_vca < 2 && note < 1.0f && note_prev >= 1.0f) {
 		mode_vca = 2;// Input set to gate. Note ending.
 		number_vca = 1;// first step of this phase
 		target_vca = unsigned(DECAY_VCA_NOTE_END/dt);// fast declicker
-		factor_vca = (current_vca-0.0f) / float(target_vca);// Linear go to 0.0 (offset)
+		vca.setLinear(-(vca.level-0.0f) / float(target_vca));// Linear go to 0.0 (offset)
 	} else if (mode_vca > 2) {//can be 3 or 4 if just was in vca_env_acc()
 		// ended decay
 		number_vca = 0;// we wont get it too high
@@ -507,46 +645,24 @@ float Bass::vca_env(bool gate, float note,  float resonance, float knob_accent)
 		number_vca = 1;// first step of this phase
 		target_vca = unsigned(DECAY_VCA_SECS/dt);// Number of steps to decay
 		if (DECAY_VCA_EXP) {
-			factor_vca = 1.0f + ((log(minimum) - log(current_vca)) / float(target_vca));// Smooth exp decay down to minimum. (factor)
+			vca.setExponential(1.0f + ((log(minimum) - log(vca.level)) / float(target_vca)));// Smooth exp decay down to minimum. (factor)
 		} else {
-			factor_vca = (current_vca-minimum) / float(target_vca);// Linear decay down to minimum. (offset)
+			vca.setLinear(-(vca.level-minimum) / float(target_vca));// Linear decay down to minimum. (offset)
 		}
 	} else if (number_vca > target_vca) {
 		// end decay or end note decay
 		mode_vca = 3;
 	}
 
-	switch (mode_vca) {
-		case 0: {//attack
-			level = current_vca+factor_vca;
-			current_vca = level;
-			this->vca_lights(1,0,0,0);
-			break;
-		} case 1: { //decay
-			if (DECAY_VCA_EXP) {
-				level = current_vca*factor_vca;
-			} else {
-				level = current_vca-factor_vca;
-			}
-			current_vca = level;
-			this->vca_lights(0,0,level,0);
-			break;
-		} case 2: { //end note
-			level = current_vca-factor_vca;
-			current_vca = level;
-			this->vca_lights(0,0,0,clamp(1-level,0.0f,1.0f));
-			break;
-		} default: {
-			level = 0.0f;
-			current_vca = minimum;
-			this->vca_lights(0,0,0,1);
-		}
+	if (mode_vca < 3) {
+		// attack, decay or end note
+		return vca.process();
 	}
-	return level;
+	vca.level = minimum;
+	return 0.0f;
 }
 
-float Bass::vca_env_acc(bool gate, float note,  float resonance, float knob_accent) {
-	float dt = APP->engine->getSampleTime();
+float Bass::vca_env_acc(bool gate, float note,  float resonance, float knob_accent, float dt) {
 	float level = 0.0f;
 
 	float attack_vca_accent_peak = (1.0f+ACCENT_ENVELOPE_VCA_OFFSET*knob_accent);
@@ -555,16 +671,19 @@ float Bass::vca_env_acc(bool gate, float note,  float resonance, float knob_acce
 	//std::cout <<     "AccMode "+std::to_string(mode_vca)+" Number "+std::to_string(number_vca)+" Target "+std::to_string(target_vca)+"\n";
 	if (gate && !gate_prev) {
 		mode_vca = 0;// attack phase
-		float fraction = accentAttackCurveInverse(current_vca/attack_vca_accent_peak);
+		float fraction = accentAttackCurveInverse(vca.level/attack_vca_accent_peak);
 		float attack_time = ATTACK_VCF_ACCENT*resonance+ATTACK_VCA;
 		target_vca = unsigned(attack_time/dt);// How many steps to get amp to attack_vca_accent_peak from zero
 		number_vca = 1+unsigned(fraction*float(target_vca));// We do this to avoid click when rising from prev level.			
-		//std::cout <<     "Attack "+std::to_string(fraction)+" Target "+std::to_string(target_vca)+" Number "+std::to_string(number_vca)+" Volts "+std::to_string(current_vca)+"\n";
+		if (target_vca > 0) {
+			vca.setQuadratic(0.0f, attack_vca_accent_peak, float(number_vca), float(target_vca));
+		}
+		//std::cout <<     "Attack "+std::to_string(fraction)+" Target "+std::to_string(target_vca)+" Number "+std::to_string(number_vca)+" Volts "+std::to_string(vca.level)+"\n";
 	} else if (gateInput && mode_vca < 3 && note < 1.0f && note_prev >= 1.0f) {
 		mode_vca = 3;// Input set to gate. Note ending.
 		number_vca = 1;// first step of this phase
 		target_vca = unsigned(DECAY_VCA_NOTE_END/dt);// fast declicker
-		factor_vca = (current_vca-0.0f) / float(target_vca);// Linear go to 0.0 (offset)
+		vca.setLinear(-(vca.level-0.0f) / float(target_vca));// Linear go to 0.0 (offset)
 	} else if (mode_vca > 3) {
 		// ended decay
 		number_vca = 0;// we wont get it too high
@@ -589,40 +708,49 @@ float Bass::vca_env_acc(bool gate, float note,  float resonance, float knob_acce
 
 	switch (mode_vca) {
 		case 0: {//attack
-			float fraction = target_vca==0?1.0f:float(number_vca)/float(target_vca);
-			level = this->accentAttackCurve(fraction) * attack_vca_accent_peak;
-			current_vca = level;
-			this->vca_lights(1,0,0,0);
+			if (target_vca == 0) {
+				vca.level = attack_vca_accent_peak;
+			} else {
+				vca.process();
+			}
+			level = vca.level;
 			break;
 		} case 1: { //peak
 			level = attack_vca_accent_peak;
-			current_vca = level;
-			this->vca_lights(0,1,0,0);
+			vca.level = level;
 			break;
 		} case 2: { //decay
-			float fraction = float(number_vca)/float(target_vca);
-			level = attack_vca_accent_peak * powf(1.0f+fraction*2.0f,-fraction*6.0f);
-			current_vca = level;
-			this->vca_lights(0,0,level,0);
+			level = this->accentDecay(vca, number_vca, target_vca, attack_vca_accent_peak, 6.0f);
 			break;
 		} case 3: { //end note
-			level = current_vca-factor_vca;
-			current_vca = level;
-			this->vca_lights(0,0,0,clamp(1-level,0.0f,1.0f));
+			level = vca.process();
 			break;
 		} default: { // silence
 			level = 0.0f;
-			current_vca = minimum;
-			this->vca_lights(0,0,0,1);
+			vca.level = minimum;
 		}
 	}
 	return level;
 }
 
+float Bass::accentDecayCurve(float fraction, float power) {
+	return powf(1.0f+fraction*2.0f,-fraction*power);
+}
 
+// Accent decays: peak * (1+2x)^(-power*x). Every bass_env_refresh samples the level is put on the exact curve,
+// and the exponential factor that reaches the curve again at the next anchor is computed. In between it is one multiply.
+float Bass::accentDecay(EnvelopeSegment<float>& env, int number, int target, float peak, float power) {
+	if ((number - 1) % bass_env_refresh == 0) {
+		float level_now  = peak * this->accentDecayCurve(float(number)/float(target), power);
+		float level_next = peak * this->accentDecayCurve(float(number + bass_env_refresh)/float(target), power);
+		env.level = level_now;
+		env.setExponential(pow(level_next / level_now, 1.0f / bass_env_refresh));
+		return level_now;
+	}
+	return env.process();
+}
 
-float Bass::filter_env(bool gate, float note, float knob_env_decay, float accent, float resonance, float knob_accent) {
-	float dt = APP->engine->getSampleTime();
+float Bass::filter_env(bool gate, float note, float knob_env_decay, float accent, float resonance, float knob_accent, float dt) {
 	float level = 0.0f;
 
 	number_cutoff += 1;
@@ -639,8 +767,11 @@ float Bass::filter_env(bool gate, float note, float knob_env_decay, float accent
 		target_cutoff = int(attack_time/dt);
 		
 		if(accentBool) {
-			accentAttackPeak = clamp(1.00f+0.25f*knob_accent+float(accentBool)*knob_accent*current_cutoff,0.0f,CUTOFF_MAX_STACKING);
-			accentAttackBase = current_cutoff;
+			accentAttackPeak = clamp(1.00f+0.25f*knob_accent+float(accentBool)*knob_accent*vcf.level,0.0f,CUTOFF_MAX_STACKING);
+			accentAttackBase = vcf.level;
+			if (target_cutoff > 0) {
+				vcf.setQuadratic(accentAttackBase, accentAttackPeak - accentAttackBase, 1.0f, float(target_cutoff));
+			}
 		}
 		//std::cerr <<     "dt             = "+std::to_string(dt)+"\n";
 		//std::cerr <<     "Attack time    = "+std::to_string(attack_time)+"\n";
@@ -654,7 +785,7 @@ float Bass::filter_env(bool gate, float note, float knob_env_decay, float accent
 		// ended decay
 		number_cutoff = 0;// we wont get it too high
 		target_cutoff = 0;
-		current_cutoff = 0.0f;
+		vcf.level = 0.0f;
 		return 0.0f;
 	} else if (mode_cutoff == 1 && number_cutoff > target_cutoff) {
 		// start decay
@@ -666,9 +797,9 @@ float Bass::filter_env(bool gate, float note, float knob_env_decay, float accent
 			
 		} else {
 			if (DECAY_VCF_EXP) {
-				factor_cutoff = 1.0f + ((log(minimum) - log(current_cutoff)) / float(target_cutoff));
+				vcf.setExponential(1.0f + ((log(minimum) - log(vcf.level)) / float(target_cutoff)));
 			} else {
-				factor_cutoff = (current_cutoff-minimum)/ float(target_cutoff);
+				vcf.setLinear(-(vcf.level-minimum)/ float(target_cutoff));
 			}
 		}
 	} else if (mode_cutoff == 0 && number_cutoff >= target_cutoff) {
@@ -682,7 +813,7 @@ float Bass::filter_env(bool gate, float note, float knob_env_decay, float accent
 		}
 	} else if (number_cutoff > target_cutoff) {
 		// end decay
-		if (mode_cutoff == 2 and accentBool and current_cutoff > minimum) {
+		if (mode_cutoff == 2 and accentBool and vcf.level > minimum) {
 			// we allow decay to go on beyond DECAY_VCF_ACCENT until it gets to minimum
 		} else {
 			mode_cutoff += 1;
@@ -692,46 +823,63 @@ float Bass::filter_env(bool gate, float note, float knob_env_decay, float accent
 
 	switch (mode_cutoff) {
 		case 0: { //attack
-			if (accentBool) {
-				float fraction = target_cutoff==0?1.0f:float(number_cutoff)/float(target_cutoff);
-				level = this->accentAttackCurve(fraction) * (accentAttackPeak - accentAttackBase) + accentAttackBase;
+			if (accentBool && target_cutoff > 0) {
+				level = vcf.process();
+			} else if (accentBool) {
+				level = accentAttackPeak;
 			} else {
 				level = 1.0f;//instant
 			}
 			
-			current_cutoff = level;
-			
-			this->vcf_lights(1,0,0,0);
+			vcf.level = level;
 			break;
 		} case 1: { //peak
-			level = current_cutoff;
-			this->vcf_lights(0,1,0,0);
+			level = vcf.level;
 			break;
 		} case 2: { //decay
 			if(accentBool) {
-				float fraction = float(number_cutoff)/float(target_cutoff);
-				level = accentAttackPeak * powf(1.0f+fraction*2.0f,-fraction*2.0f);
+				level = this->accentDecay(vcf, number_cutoff, target_cutoff, accentAttackPeak, 2.0f);
 			} else {
-				if (DECAY_VCF_EXP) {
-					level = current_cutoff*factor_cutoff;
-				} else {
-					level = current_cutoff-factor_cutoff;
-				}
+				level = vcf.process();
 			}
-			current_cutoff = level;
-			this->vcf_lights(0,0,level,0);
 			break;
 		} default: {
 			level = 0.0f;
-			current_cutoff = minimum;
+			vcf.level = minimum;
 			number_cutoff = 0;
 			target_cutoff = 0;
-			this->vcf_lights(0,0,0,1);
 		}
 	}
 	return level;
 }
 
+// Called at UI rate, shows the phase each envelope is in.
+void Bass::env_lights() {
+	lights[E_LIGHT].value = accentBool;
+	if (accentBool) {
+		switch (mode_vca) {
+			case 0: this->vca_lights(1,0,0,0); break;
+			case 1: this->vca_lights(0,1,0,0); break;
+			case 2: this->vca_lights(0,0,vca.level,0); break;
+			case 3: this->vca_lights(0,0,0,clamp(1-vca.level,0.0f,1.0f)); break;
+			default: this->vca_lights(0,0,0,1);
+		}
+	} else {
+		switch (mode_vca) {
+			case 0: this->vca_lights(1,0,0,0); break;
+			case 1: this->vca_lights(0,0,vca.level,0); break;
+			case 2: this->vca_lights(0,0,0,clamp(1-vca.level,0.0f,1.0f)); break;
+			default: this->vca_lights(0,0,0,1);
+		}
+	}
+	switch (mode_cutoff) {
+		case 0: this->vcf_lights(1,0,0,0); break;
+		case 1: this->vcf_lights(0,1,0,0); break;
+		case 2: this->vcf_lights(0,0,vcf.level,0); break;
+		default: this->vcf_lights(0,0,0,1);
+	}
+}
+
 void Bass::vca_lights(float attack, float sustain, float decay, float end) {
 	lights[A_LIGHT].value = attack;
 	lights[B_LIGHT].value = sustain;
@@ -746,10 +894,11 @@ void Bass::vcf_lights(float attack, float sustain, float decay, float end) {
 	lights[D2_LIGHT].value = end;
 }
 
-float Bass::acid_filter(float in, float r, float F_c, int oversample_protected) {// from diagram of resonance of TB-303
+template <int OVERSAMPLE>
+float Bass::acid_filter(float in, float r, float F_c, Resampler<OVERSAMPLE, 10, float>& resampler) {// from diagram of resonance of TB-303
 	float voltage_drive = VCV_TO_MOOG*INPUT_TO_CAPACITOR;// 0.18 to convert from VCV audio rate voltages. 0.035 to convert from input to voltage over first capacitor.
 	in *= voltage_drive;
-	F_s   = APP->engine->getSampleRate()*oversample_protected;
+	F_s   = APP->engine->getSampleRate()*OVERSAMPLE;
 
 	double w_c = double(2.0f*M_PI*F_c/F_s);// cutoff in radians per sample.
 	g = V_t * (0.0008116984 + 0.9724111*w_c - 0.5077766*w_c*w_c + 0.1534058*w_c*w_c*w_c);// new auto tuned g for cutoff  4th order: y = 0.00007055354 + 0.9960577*x - 0.6082669*x^2 + 0.286043*x^3 - 0.05393212*x^4
@@ -768,48 +917,18 @@ float Bass::acid_filter(float in, float r, float F_c, int oversample_protected)
 		g2 = g;
 	}
 
-	float inInter [oversample_protected];
-	float outBuf  [oversample_protected];
-	if (oversample_protected == oversample2) {
-		upsampler2.process(in, inInter);
+	float inInter [OVERSAMPLE];
+	float outBuf  [OVERSAMPLE];
+	if (oscillatorShape == OSC_EXTERNAL) {
+		resampler.upsample(in, inInter);
 	} else {
-		upsampler4.process(in, inInter);
-	}
-
-	for (int i = 0; i < oversample_protected; i++) {
-		x   = inInter[i] - 2.0f*Gres*r*(y_d_prev+y_d_prev_prev-priority*inInter[i]);//unit and a half feedback delay. -inInter[i] is Gcomp, to make passband gain not decrease too much when turning up resonance.
-
-		// 1st transistor stage:
-		y_a = y_a_prev+g2*(non_lin_func( x/V_t )-W_a_prev);
-		W_a = non_lin_func( y_a/V_t );
-		// 2nd transistor stage:
-		y_b = y_b_prev+g*(W_a-W_b_prev);
-		W_b = non_lin_func( y_b/V_t );
-		// 3rd transistor stage:
-		y_c = y_c_prev+g*(W_b-W_c_prev);
-		W_c = non_lin_func( y_c/V_t );
-		// 4th transistor stage:
-		y_d = y_d_prev+g*(W_c-non_lin_func( y_d_prev/V_t ));
-
-		// record stuff for next step
-		y_d_prev_prev = y_d_prev;
-		y_a_prev = y_a;
-		y_b_prev = y_b;
-		y_c_prev = y_c;
-		y_d_prev = y_d;
-
-		W_a_prev = W_a;
-		W_b_prev = W_b;
-		W_c_prev = W_c;
-		
-		outBuf[i] = y_d;
-	}
-	float out;
-	if (oversample_protected == oversample2) {
-		out = decimator2.process(outBuf);
-	} else {
-		out = decimator4.process(outBuf);
+		oscillator.process<OVERSAMPLE>(inInter, clamp(osc_freq / F_s, 0.0f, 0.5f), oscillatorShape == OSC_SQUARE);
+		for (int i = 0; i < OVERSAMPLE; i++) {
+			inInter[i] *= OSC_INTERNAL_VOLT * voltage_drive;
+		}
 	}
+	ladder.process<OVERSAMPLE>(inInter, outBuf, g2, g, 2.0f*Gres*r, priority);
+	float out = resampler.downsample(outBuf);
 	if(!std::isfinite(out)) {
 		out = 0.0f;
 	}
@@ -827,7 +946,7 @@ struct OversampleBassMenuItem : MenuItem {
 	}
 
 	void onAction(const event::Action &e) override {
-		_module->current_oversample = _os;
+		_module->setOversample(_os);
 	}
 
 	void step() override {
@@ -835,6 +954,25 @@ struct OversampleBassMenuItem : MenuItem {
 	}
 };
 
+struct OscillatorBassMenuItem : MenuItem {
+	Bass* _module;
+	int _shape;
+
+	OscillatorBassMenuItem(Bass* module, const char* label, int shape)
+	: _module(module), _shape(shape)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->oscillatorShape = _shape;
+	}
+
+	void step() override {
+		rightText = _module->oscillatorShape == _shape ? "✔" : "";
+	}
+};
+
 struct PoleMenuItem : MenuItem {
 	Bass* _module;
 
@@ -953,6 +1091,11 @@ struct BassWidget : ModuleWidget {
 		menu->addChild(new MenuLabel());
 		menu->addChild(new OversampleBassMenuItem(a, "Oversample x2", 2));
 		menu->addChild(new OversampleBassMenuItem(a, "Oversample x4", 4));
+		appendResamplerMenu(menu, a);
+		menu->addChild(new MenuLabel());
+		menu->addChild(new OscillatorBassMenuItem(a, "Oscillator: external input", OSC_EXTERNAL));
+		menu->addChild(new OscillatorBassMenuItem(a, "Oscillator: internal saw", OSC_SAW));
+		menu->addChild(new OscillatorBassMenuItem(a, "Oscillator: internal square", OSC_SQUARE));
 		//menu->addChild(new MenuLabel());
 		//menu->addChild(new ResTuneMenuItem(a, "Tuned Resonance"));
 		//menu->addChild(new MenuLabel());
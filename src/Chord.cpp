@@ -98,6 +98,7 @@ struct Chord : Module {
 	json_t *dataToJson() override {
 		json_t *root = json_object();
 		json_object_set_new(root, "chordIndex", json_integer(chordIndex));
+		json_object_set_new(root, "seed", rng.toJson());
 		return root;
 	}
 
@@ -106,11 +107,13 @@ struct Chord : Module {
 		if (ext3) {
 			chordIndex = json_integer_value(ext3);
 		}
+		rng.fromJson(json_object_get(rootJ, "seed"));
 	}
 
 	float semitone = 1.0f/12.0f;
 	bool trig_prev = false;
 	int chordIndex = 0;
+	SeededRandom rng;
 
 	void process(const ProcessArgs &args) override;
 };
@@ -126,7 +129,7 @@ void Chord::process(const ProcessArgs &args) {
 	bool trig = inputs[TRIGGER_INPUT].getVoltage() >= 1.0f;
 
 	if (trig && !trig_prev) {
-		chordIndex = (rand() % static_cast<int>(NUM_CHORDS));
+		chordIndex = rng.below(NUM_CHORDS);
 	}
 
 	for (int light = 0; light < NUM_CHORDS; light++) {
@@ -23,7 +23,7 @@
 
 static const int oversample = 2;
 
-struct Deadband : Module {
+struct Deadband : ResampledModule<oversample, 8> {
 	enum ParamIds {
 		WIDTH_PARAM,
 		CV_PARAM,
@@ -44,9 +44,6 @@ struct Deadband : Module {
 	enum LightIds {
 		NUM_LIGHTS
 	};
-	
-	dsp::Upsampler<oversample, 8> upsampler = dsp::Upsampler<oversample, 8>(0.9f);
-	dsp::Decimator<oversample, 8> decimator = dsp::Decimator<oversample, 8>(0.9f);
 
 	Deadband() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -83,7 +80,7 @@ void Deadband::process(const ProcessArgs &args) {
 	float inBuf   [oversample];
 	float outBuf  [oversample];
 	
-	upsampler.process(input, inBuf);
+	resampler[0].upsample(input, inBuf);
 	
 	for (int i = 0; i < oversample; i++) {
 		float unlimit = inBuf[i];
@@ -97,10 +94,10 @@ void Deadband::process(const ProcessArgs &args) {
 		}
 		outBuf[i] = limit;
 	}
-    outputs[DEADBAND_OUTPUT].setVoltage(decimator.process(outBuf));;
+    outputs[DEADBAND_OUTPUT].setVoltage(resampler[0].downsample(outBuf));;
 }
 
-struct DeadbandWidget : ModuleWidget {
+struct DeadbandWidget : ResampledModuleWidget<Deadband> {
 	DeadbandWidget(Deadband *module) {
 		setModule(module);
 		setPanel(createPanel(asset::plugin(pluginInstance, "res/DeadbandModule.svg")));
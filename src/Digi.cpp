@@ -23,7 +23,7 @@
 
 static const int oversample = 2;
 
-struct Digi : Module {
+struct Digi : ResampledModule<oversample, 8> {
 	enum ParamIds {
 		STEP_PARAM,
 		CV_PARAM,
@@ -41,9 +41,6 @@ struct Digi : Module {
 	enum LightIds {
 		NUM_LIGHTS
 	};
-	
-	dsp::Upsampler<oversample, 8> upsampler = dsp::Upsampler<oversample, 8>(0.9f);
-	dsp::Decimator<oversample, 8> decimator = dsp::Decimator<oversample, 8>(0.9f);
 
 	Digi() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -76,7 +73,7 @@ void Digi::process(const ProcessArgs &args) {
 	float inBuf   [oversample];
 	float outBuf  [oversample];
 	
-	upsampler.process(input, inBuf);
+	resampler[0].upsample(input, inBuf);
 	
 	for (int i = 0; i < oversample; i++) {
 		float analog  = inBuf[i];
@@ -92,10 +89,10 @@ void Digi::process(const ProcessArgs &args) {
 		}
 		outBuf[i] = digital + 0.5f*jump;
 	}
-    outputs[DIGITAL_OUTPUT].setVoltage(decimator.process(outBuf));
+    outputs[DIGITAL_OUTPUT].setVoltage(resampler[0].downsample(outBuf));
 }
 
-struct DigiWidget : ModuleWidget {
+struct DigiWidget : ResampledModuleWidget<Digi> {
 	DigiWidget(Digi *module) {
 		setModule(module);
 		setPanel(createPanel(asset::plugin(pluginInstance, "res/DigiModule.svg")));
@@ -1,8 +1,7 @@
 #include "Autinn.hpp"
 #include <cmath>
-#include <queue>
-
-using std::queue;
+#include <vector>
+#include <algorithm>
 
 /*
 
@@ -24,6 +23,8 @@ using std::queue;
 
 **/
 
+static const float disee_max_window = 1000.0f;// ms, the longest window in the menu and in saved patches
+
 struct Disee : Module {
 	enum ParamIds {
 		NUM_PARAMS
@@ -43,9 +44,21 @@ struct Disee : Module {
 		NUM_LIGHTS
 	};
 
-	float dc_prev;
-	unsigned size = 12500;// fixed for now.
-	queue <float> buffer;
+	// Ring of the last window of samples, one per group of 4 voices.
+	// Allocated for the longest window on sample rate change, so the audio path never allocates.
+	std::vector<simd::float_4> buffer[4];
+	// Running sum of the ring, and a sum restarted every pass that replaces it when the ring wraps, so float error cannot pile up.
+	simd::float_4 sum[4];
+	simd::float_4 freshSum[4];
+	int size = 1;
+	int writeIndex = 0;
+	bool filled = false;
+
+	float window = 280.0f;// ms, close to the old fixed 12500 samples at 44.1KHz.
+	float window_prev = -1;
+	float rate_prev = -1;
+	int channels_prev = 0;
+	int step = 0;
 
 	Disee() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -55,34 +68,68 @@ struct Disee : Module {
 		configLight(DC_BLUE_LIGHT, "Negative DC");
 		configInput(AC_INPUT, "AC");
 		configOutput(DC_OUTPUT, "DC");
+		allocateBuffer(44100.0f);
+	}
+
+	void onSampleRateChange(const SampleRateChangeEvent& e) override {
+		allocateBuffer(e.sampleRate);
+	}
+
+	void onReset(const ResetEvent& e) override {
+		window = 280.0f;
+		Module::onReset(e);
+	}
+
+	json_t *dataToJson() override {
+		json_t *root = json_object();
+		json_object_set_new(root, "window", json_real(window));
+		return root;
+	}
+
+	void dataFromJson(json_t *root) override {
+		json_t *ext = json_object_get(root, "window");
+		if (ext) {
+			window = clamp((float) json_number_value(ext), 1.0f, disee_max_window);
+		}
 	}
 
 	void process(const ProcessArgs &args) override;
+	void allocateBuffer(float rate);
+	void resizeBuffer(float rate);
+	void clearGroups(int channels);
+	void setLights(float dc);
 };
 
-void Disee::process(const ProcessArgs &args) {
-	// Implements a DC detector
+// Every group gets a ring for the longest window up front, so neither the window nor the channel count allocates.
+void Disee::allocateBuffer(float rate) {
+	int capacity = std::max(1, int(disee_max_window * 0.001f * rate));
+	for (int g = 0; g < 4; g++) {
+		buffer[g].assign(capacity, simd::float_4(0.0f));
+	}
+	rate_prev = -1;
+}
 
-	// VCV Rack audio rate is +-5V
-	// VCV Rack CV is +-5V or 0V-10V
+// The samples left in the ring are overwritten before the first pass completes, and the sums are only used after it.
+void Disee::resizeBuffer(float rate) {
+	size = clamp(int(window * 0.001f * rate), 1, (int) buffer[0].size());
+	for (int g = 0; g < 4; g++) {
+		sum[g] = 0.0f;
+		freshSum[g] = 0.0f;
+	}
+	writeIndex = 0;
+	filled = false;
+}
 
-	// TODO: Make buffer size depend on bitrate and review the time it should average over.
-	//       Right now its 0.28 seconds for 44.1KHz
-	//       Right now its 0.26 seconds for 48.0KHz
-	
-	float in = inputs[AC_INPUT].getVoltage()/size;
-	buffer.push(in);
-	float in_oldest = buffer.front();
-	float dc = dc_prev - in_oldest + in;
-	dc_prev = dc;
-	if (buffer.size() < size) {
-		lights[DC_GREEN_LIGHT].value = 0.0f;
-		lights[DC_RED_LIGHT].value = 0.0f;
-		lights[DC_BLUE_LIGHT].value = 0.0f;
-		return;
+// Groups that were not in use hold stale samples, the groups still running keep their window.
+void Disee::clearGroups(int channels) {
+	for (int g = (channels_prev + 3) / 4; g * 4 < channels; g++) {
+		std::fill(buffer[g].begin(), buffer[g].begin() + size, simd::float_4(0.0f));
+		sum[g] = 0.0f;
+		freshSum[g] = 0.0f;
 	}
-	outputs[DC_OUTPUT].setVoltage(clamp(dc,-10000.0f,10000.0f));
-	buffer.pop();
+}
+
+void Disee::setLights(float dc) {
 	if (fabs(dc) < 0.05f) {
 		lights[DC_GREEN_LIGHT].value = 1.0f;
 		lights[DC_RED_LIGHT].value = 0.0f;
@@ -95,9 +142,87 @@ void Disee::process(const ProcessArgs &args) {
 		lights[DC_GREEN_LIGHT].value = 0.0f;
 		lights[DC_RED_LIGHT].value = clamp(dc,0.25f,1.0f);
 		lights[DC_BLUE_LIGHT].value = 0.0f;
-	}	
+	}
+}
+
+void Disee::process(const ProcessArgs &args) {
+	// Implements a DC detector
+
+	// VCV Rack audio rate is +-5V
+	// VCV Rack CV is +-5V or 0V-10V
+
+	int channels = std::max(1, inputs[AC_INPUT].getChannels());
+	if (args.sampleRate != rate_prev || window != window_prev) {
+		this->resizeBuffer(args.sampleRate);
+		rate_prev = args.sampleRate;
+		window_prev = window;
+	}
+	if (channels != channels_prev) {
+		this->clearGroups(channels);
+		channels_prev = channels;
+	}
+
+	for (int c = 0; c < channels; c += 4) {
+		int g = c / 4;
+		simd::float_4 in = inputs[AC_INPUT].getVoltageSimd<simd::float_4>(c);
+		simd::float_4& in_oldest = buffer[g][writeIndex];
+		sum[g] += in - in_oldest;
+		freshSum[g] += in;
+		in_oldest = in;
+	}
+	writeIndex++;
+	if (writeIndex >= size) {
+		writeIndex = 0;
+		filled = true;
+		for (int g = 0; g < 4; g++) {
+			sum[g] = freshSum[g];
+			freshSum[g] = 0.0f;
+		}
+	}
+
+	outputs[DC_OUTPUT].setChannels(channels);
+	if (!filled) {
+		lights[DC_GREEN_LIGHT].value = 0.0f;
+		lights[DC_RED_LIGHT].value = 0.0f;
+		lights[DC_BLUE_LIGHT].value = 0.0f;
+		return;
+	}
+	float dc_max = 0.0f;// the voice furthest from zero drives the light
+	for (int c = 0; c < channels; c += 4) {
+		simd::float_4 dc = simd::clamp(sum[c / 4] / size, -10000.0f, 10000.0f);
+		outputs[DC_OUTPUT].setVoltageSimd(dc, c);
+		for (int k = 0; k < 4 && c + k < channels; k++) {
+			if (fabs(dc[k]) > fabs(dc_max)) {
+				dc_max = dc[k];
+			}
+		}
+	}
+	step++;
+	if (step >= 32) {
+		step = 0;
+		this->setLights(dc_max);
+	}
 }
 
+struct DiseeWindowMenuItem : MenuItem {
+	Disee* _module;
+	float _window;
+
+	DiseeWindowMenuItem(Disee* module, const char* label, float window)
+	: _module(module), _window(window)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->window = _window;
+	}
+
+	void step() override {
+		rightText = _module->window == _window ? "✔" : "";
+	}
+};
+
 struct DiseeWidget : ModuleWidget {
 	DiseeWidget(Disee *module) {
 		setModule(module);
@@ -113,6 +238,19 @@ struct DiseeWidget : ModuleWidget {
 
 		addChild(createLight<MediumLight<RedGreenBlueLight>>(Vec(3 * RACK_GRID_WIDTH*0.5-9.378*0.5, 75), module, Disee::DC_RED_LIGHT));
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		Disee *a = dynamic_cast<Disee*>(module);
+		assert(a);
+
+		menu->addChild(new MenuLabel());
+		menu->addChild(new DiseeWindowMenuItem(a, "Window: 10 ms", 10.0f));
+		menu->addChild(new DiseeWindowMenuItem(a, "Window: 50 ms", 50.0f));
+		menu->addChild(new DiseeWindowMenuItem(a, "Window: 100 ms", 100.0f));
+		menu->addChild(new DiseeWindowMenuItem(a, "Window: 280 ms", 280.0f));
+		menu->addChild(new DiseeWindowMenuItem(a, "Window: 500 ms", 500.0f));
+		menu->addChild(new DiseeWindowMenuItem(a, "Window: 1000 ms", 1000.0f));
+	}
 };
 
 Model *modelDC = createModel<Disee, DiseeWidget>("Disee");
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "Autinn.hpp"
 #include <cmath>
+#include <algorithm>
 
 /*
 
@@ -28,6 +29,9 @@ static const int oversample8 = 8;
 #define DRIVE_MAX 10.0f
 #define DRIVE_MIN 0.1f
 
+static const int fil_table_size = 1024;// points over the part of the curve that is not flat
+static const int fil_light_rate = 16;
+
 struct Fil : Module {
 	enum ParamIds {
 		DIAL_PARAM,
@@ -58,42 +62,166 @@ struct Fil : Module {
 		configLight(HIGH_LIGHT, "Serious grinding going on.. ");
 		configLight(MID_LIGHT, "Moderate filing.. ");
 		configLight(LOW_LIGHT, "Hungry, feed me!  ");
+
+		this->buildTable();
 	}
 
 	int current_oversample = 4;
-	float th=1.0f/3.0f;
+	int resamplerQuality = RESAMPLER_STANDARD;
+	const float th=1.0f/3.0f;
+	bool useTable = false;
+	int step = 0;
 
-	dsp::Upsampler<oversample2, 10> upsampler2;
-	dsp::Decimator<oversample2, 10> decimator2;
-	dsp::Upsampler<oversample4, 10> upsampler4;
-	dsp::Decimator<oversample4, 10> decimator4;
-	dsp::Upsampler<oversample8, 10> upsampler8;
-	dsp::Decimator<oversample8, 10> decimator8;
+	// The full shaping curve for inputs 0 to 2*th, beyond that it is flat. Negative inputs use symmetry.
+	// Each entry holds a point and the next one, so a lane reads both ends of its segment from one place.
+	float table[fil_table_size + 1][2];
+	float tableScale = 0.0f;
+
+	// up to 16 voices, 4 per SIMD lane group
+	Resampler<oversample2, 10, simd::float_4> resampler2[4];
+	Resampler<oversample4, 10, simd::float_4> resampler4[4];
+	Resampler<oversample8, 10, simd::float_4> resampler8[4];
 
 	json_t *dataToJson() override {
 		json_t *root = json_object();
 		json_object_set_new(root, "oversample", json_integer(current_oversample));
+		json_object_set_new(root, "table", json_boolean(useTable));
+		json_object_set_new(root, "resampler", json_integer(resamplerQuality));
 		return root;
 	}
 
 	void dataFromJson(json_t *rootJ) override {
 		json_t *ext3 = json_object_get(rootJ, "oversample");
 		if (ext3) {
-			current_oversample = json_integer_value(ext3);
-			if (current_oversample != 2 and current_oversample != 4 and current_oversample != 8) {
-				current_oversample = 4;
+			int os = json_integer_value(ext3);
+			if (os != 2 and os != 4 and os != 8) {
+				os = 4;
 			}
+			this->setOversample(os);
+		}
+		json_t *ext = json_object_get(rootJ, "table");
+		if (ext) {
+			useTable = json_boolean_value(ext);
+		}
+		json_t *ext4 = json_object_get(rootJ, "resampler");
+		if (ext4) {
+			this->setResamplerQuality(clamp((int) json_integer_value(ext4), 0, NUM_RESAMPLER_QUALITIES - 1));
 		}
 	}
 
 	void onReset(const ResetEvent& e) override {
-		current_oversample = 4;
+		this->setOversample(4);
+		useTable = false;
+		this->setResamplerQuality(RESAMPLER_STANDARD);
 		Module::onReset(e);
 	}
 
 	void process(const ProcessArgs &args) override;
+	template <int OVERSAMPLE>
+	simd::float_4 overdrive(simd::float_4 in, Resampler<OVERSAMPLE, 10, simd::float_4>& resampler);
+	simd::float_4 overdrive2(int g, simd::float_4 in) {
+		return this->overdrive<oversample2>(in, resampler2[g]);
+	}
+	simd::float_4 overdrive4(int g, simd::float_4 in) {
+		return this->overdrive<oversample4>(in, resampler4[g]);
+	}
+	simd::float_4 overdrive8(int g, simd::float_4 in) {
+		return this->overdrive<oversample8>(in, resampler8[g]);
+	}
+	simd::float_4 (Fil::*overdrive_func)(int g, simd::float_4 in) = &Fil::overdrive4;// chosen once by setOversample() instead of every sample
+
+	void setOversample(int os) {
+		current_oversample = os;
+		if (os == oversample2) {
+			overdrive_func = &Fil::overdrive2;
+		} else if (os == oversample8) {
+			overdrive_func = &Fil::overdrive8;
+		} else {
+			overdrive_func = &Fil::overdrive4;
+		}
+	}
+
+	void setResamplerQuality(int quality) {
+		resamplerQuality = quality;
+		for (int g = 0; g < 4; g++) {
+			resampler2[g].setQuality(quality);
+			resampler4[g].setQuality(quality);
+			resampler8[g].setQuality(quality);
+		}
+	}
+
+	float shape(float x);
+	simd::float_4 shape(simd::float_4 x);
+	simd::float_4 shapeTable(simd::float_4 x);
+	void buildTable();
+	void setLights(float x);
 };
 
+// Three region soft clipper followed by the tanh like non_lin_func.
+float Fil::shape(float x) {
+	float out;
+	if (fabs(x) < th) {
+		out = 2.0f*x;
+	} else if (fabs(x) <= 2.0f*th) {
+		if (x > 0.0f) {
+			out = (3.0f-(2.0f-x*3.0f)*(2.0f-x*3.0f))/3.0f;
+		} else {
+		    out = -(3.0f-(2.0f-fabs(x)*3.0f)*(2.0f-fabs(x)*3.0f))/3.0f;
+		}
+	} else {
+		if (x > 0.0f) {
+			out =  1.0f;
+		} else {
+			out = -1.0f;
+		}
+	}
+	return non_lin_func(out);
+}
+
+void Fil::buildTable() {
+	tableScale = fil_table_size / (2.0f*th);
+	for (int i = 0; i <= fil_table_size; i++) {
+		table[i][0] = this->shape(i / tableScale);
+		table[i][1] = this->shape(std::min(i + 1, fil_table_size) / tableScale);
+	}
+}
+
+// Same as above in float lanes.
+simd::float_4 Fil::shape(simd::float_4 x) {
+	simd::float_4 x_abs = simd::fabs(x);
+	simd::float_4 mid = (3.0f-(2.0f-x_abs*3.0f)*(2.0f-x_abs*3.0f))/3.0f;
+	simd::float_4 out = simd::ifelse(x_abs < th, 2.0f*x_abs, simd::ifelse(x_abs <= 2.0f*th, mid, 1.0f));
+	return non_lin_func(simd::ifelse(x < 0.0f, -out, out));
+}
+
+// Same curve as shape(), linear interpolation in the table, each lane looks up its own point.
+simd::float_4 Fil::shapeTable(simd::float_4 x) {
+	simd::float_4 index = simd::fmin(simd::fabs(x) * tableScale, float(fil_table_size));
+	simd::int32_4 i = simd::int32_4(index);// truncates, same as floor since index is not negative
+	simd::float_4 portion = index - simd::float_4(i);
+	simd::float_4 low(table[i[0]][0], table[i[1]][0], table[i[2]][0], table[i[3]][0]);
+	simd::float_4 high(table[i[0]][1], table[i[1]][1], table[i[2]][1], table[i[3]][1]);
+	simd::float_4 out = low + (high - low) * portion;
+	return simd::ifelse(x < 0.0f, -out, out);
+}
+
+void Fil::setLights(float x) {
+	if (fabs(x) < th) {
+		lights[LOW_LIGHT].value = fabs(2.0f*x)/(th*2.0f);
+		lights[MID_LIGHT].value = 0.0f;
+		lights[HIGH_LIGHT].value = 0.0f;
+	} else if (fabs(x) <= 2.0f*th) {
+		float out = (3.0f-(2.0f-fabs(x)*3.0f)*(2.0f-fabs(x)*3.0f))/3.0f;
+		lights[MID_LIGHT].value = (out-th*2.0f)*3.0f;
+		lights[LOW_LIGHT].value = 0.0f;
+		lights[HIGH_LIGHT].value = 0.0f;
+	} else {
+		lights[HIGH_LIGHT].value = (fabs(x)-th*2.0f)*2.0f;
+		lights[MID_LIGHT].value = 0.0f;
+		lights[LOW_LIGHT].value = 0.0f;
+	}
+}
+
 void Fil::process(const ProcessArgs &args) {
 	// VCV Rack audio rate is +-5V
 	// VCV Rack CV is +-5V or 0V-10V
@@ -102,61 +230,45 @@ void Fil::process(const ProcessArgs &args) {
 		return;
 	}
 
-	float in = 0.20f * inputs[FIL_INPUT].getVoltage() * (params[DIAL_PARAM].getValue() * (DRIVE_MAX - DRIVE_MIN) + DRIVE_MIN);
-	float out = 0.0f;
+	int channels = std::max(1, inputs[FIL_INPUT].getChannels());
+	float drive = 0.20f * (params[DIAL_PARAM].getValue() * (DRIVE_MAX - DRIVE_MIN) + DRIVE_MIN);
+	float light_in = 0.0f;
 
-	float inInter [current_oversample];
-	float outBuf  [current_oversample];
-	if (current_oversample == oversample2) {
-		upsampler2.process(in, inInter);
-	} else if (current_oversample == oversample4) {
-		upsampler4.process(in, inInter);
-	} else {
-		upsampler8.process(in, inInter);
-	}
-	
-	for (int i = 0; i < current_oversample; i++) {
-		if (fabs(inInter[i]) < th) {
-			out = 2.0f*inInter[i];
-			if (i==0) {
-				lights[LOW_LIGHT].value = fabs(out)/(th*2.0f);
-				lights[MID_LIGHT].value = 0.0f;
-				lights[HIGH_LIGHT].value = 0.0f;
-			}
-		} else if (fabs(inInter[i]) <= 2.0f*th) {
-			if (inInter[i] > 0.0f) {
-				out = (3.0f-(2.0f-inInter[i]*3.0f)*(2.0f-inInter[i]*3.0f))/3.0f;
-			} else {
-			    out = -(3.0f-(2.0f-fabs(inInter[i])*3.0f)*(2.0f-fabs(inInter[i])*3.0f))/3.0f;
-			}
-			if (i==0) {
-				lights[MID_LIGHT].value = (fabs(out)-th*2.0f)*3.0f;
-				lights[LOW_LIGHT].value = 0.0f;
-				lights[HIGH_LIGHT].value = 0.0f;
-			}
-		} else {
-			if (inInter[i] > 0.0f) {
-				out =  1.0f;
-			} else {
-				out = -1.0f;
-			}
-			if (i==0) {
-				lights[HIGH_LIGHT].value = (fabs(inInter[i])-th*2.0f)*2.0f;
-				lights[MID_LIGHT].value = 0.0f;
-				lights[LOW_LIGHT].value = 0.0f;
-			}
+	outputs[FIL_OUTPUT].setChannels(channels);
+	for (int c = 0; c < channels; c += 4) {
+		int g = c / 4;
+		simd::float_4 in = inputs[FIL_INPUT].getVoltageSimd<simd::float_4>(c) * drive;
+		simd::float_4 out = (this->*overdrive_func)(g, in);
+		outputs[FIL_OUTPUT].setVoltageSimd(out*5.0f, c);
+
+		// the lights show the hardest driven voice
+		for (int k = 0; k < 4 && c + k < channels; k++) {
+			light_in = std::max(light_in, std::fabs(in[k]));
 		}
-		outBuf[i] = non_lin_func(out);
 	}
-	if (current_oversample == oversample2) {
-		out = decimator2.process(outBuf);
-	} else if (current_oversample == oversample4) {
-		out = decimator4.process(outBuf);
-	} else {
-		out = decimator8.process(outBuf);
+
+	step++;
+	if (step >= fil_light_rate) {
+		step = 0;
+		this->setLights(light_in);
 	}
+}
 
-    outputs[FIL_OUTPUT].setVoltage(out*5.0f);
+template <int OVERSAMPLE>
+simd::float_4 Fil::overdrive(simd::float_4 in, Resampler<OVERSAMPLE, 10, simd::float_4>& resampler) {
+	simd::float_4 inInter [OVERSAMPLE];
+	simd::float_4 outBuf  [OVERSAMPLE];
+	resampler.upsample(in, inInter);
+	if (useTable) {
+		for (int i = 0; i < OVERSAMPLE; i++) {
+			outBuf[i] = this->shapeTable(inInter[i]);
+		}
+	} else {
+		for (int i = 0; i < OVERSAMPLE; i++) {
+			outBuf[i] = this->shape(inInter[i]);
+		}
+	}
+	return resampler.downsample(outBuf);
 }
 
 struct OversampleFilMenuItem : MenuItem {
@@ -170,7 +282,7 @@ struct OversampleFilMenuItem : MenuItem {
 	}
 
 	void onAction(const event::Action &e) override {
-		_module->current_oversample = _os;
+		_module->setOversample(_os);
 	}
 
 	void step() override {
@@ -178,6 +290,25 @@ struct OversampleFilMenuItem : MenuItem {
 	}
 };
 
+struct TableFilMenuItem : MenuItem {
+	Fil* _module;
+	bool _table;
+
+	TableFilMenuItem(Fil* module, const char* label, bool table)
+	: _module(module), _table(table)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->useTable = _table;
+	}
+
+	void step() override {
+		rightText = _module->useTable == _table ? "✔" : "";
+	}
+};
+
 struct FilWidget : ModuleWidget {
 	FilWidget(Fil *module) {
 		setModule(module);
@@ -206,6 +337,10 @@ struct FilWidget : ModuleWidget {
 		menu->addChild(new OversampleFilMenuItem(a, "Oversample x2", 2));
 		menu->addChild(new OversampleFilMenuItem(a, "Oversample x4", 4));
 		menu->addChild(new OversampleFilMenuItem(a, "Oversample x8", 8));
+		appendResamplerMenu(menu, a);
+		menu->addChild(new MenuLabel());
+		menu->addChild(new TableFilMenuItem(a, "Shaper: Calculated", false));
+		menu->addChild(new TableFilMenuItem(a, "Shaper: Lookup table", true));
 	}
 };
 
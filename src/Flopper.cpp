@@ -24,7 +24,7 @@
 
 static const int oversample = 2;
 
-struct Flopper : Module {
+struct Flopper : ResampledModule<oversample, 8, 2> {
 	enum ParamIds {
 		DIAL_PARAM,
 		NUM_PARAMS
@@ -46,11 +46,6 @@ struct Flopper : Module {
 	};
 
 	float blinkTime = 0;
-	
-	dsp::Upsampler<oversample, 8> upsampler1 = dsp::Upsampler<oversample, 8>(0.9f);
-	dsp::Upsampler<oversample, 8> upsampler2 = dsp::Upsampler<oversample, 8>(0.9f);
-	dsp::Decimator<oversample, 8> decimator1 = dsp::Decimator<oversample, 8>(0.9f);
-	dsp::Decimator<oversample, 8> decimator2 = dsp::Decimator<oversample, 8>(0.9f);
 
 	Flopper() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -82,8 +77,8 @@ void Flopper::process(const ProcessArgs &args) {
 	float outBuf1  [oversample];
 	float outBuf2  [oversample];
 	
-	upsampler1.process(inputs[ONE_INPUT].getVoltage(), inBuf1);
-	upsampler2.process(inputs[TWO_INPUT].getVoltage(), inBuf2);
+	resampler[0].upsample(inputs[ONE_INPUT].getVoltage(), inBuf1);
+	resampler[1].upsample(inputs[TWO_INPUT].getVoltage(), inBuf2);
 	
 	for (int i = 0; i < oversample; i++) {
 		float in1 = inBuf1[i];
@@ -99,15 +94,15 @@ void Flopper::process(const ProcessArgs &args) {
 		outBuf2[i] = in2upper+level-in1lower;
 	}
 
-    outputs[ONE_OUTPUT].setVoltage(decimator1.process(outBuf1));
-    outputs[TWO_OUTPUT].setVoltage(decimator2.process(outBuf2));
+    outputs[ONE_OUTPUT].setVoltage(resampler[0].downsample(outBuf1));
+    outputs[TWO_OUTPUT].setVoltage(resampler[1].downsample(outBuf2));
 
 	blinkTime += args.sampleTime;
 	blinkTime = fmod(blinkTime, 1.0f);
 	lights[BLINK_LIGHT].value = (blinkTime < 0.5f) ? 1.0 : 0.0;
 }
 
-struct FlopperWidget : ModuleWidget {
+struct FlopperWidget : ResampledModuleWidget<Flopper> {
 	FlopperWidget(Flopper *module) {
 		setModule(module);
 		setPanel(createPanel(asset::plugin(pluginInstance, "res/FlopperModule.svg")));
@@ -2,10 +2,12 @@
 #include <cmath>
 
 #include <vector>
-#include <algorithm> // copy(), assign()
-#include <iterator> // back_inserter()
+#include <algorithm> // swap()
 #include <sys/time.h>
-#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 
 //#include <iostream>
@@ -45,6 +47,48 @@
 #define REST_MAX 10
 #define TONIC_MIN 60
 #define TONIC_MAX 71
+#define VOICES_MAX 4
+
+// One phrase with everything per note side by side. Fixed size so that generating and switching phrases never allocates.
+struct MelodyPhrase {
+	int notes[PHRASE_LENGTH_MAX];
+	int durations[PHRASE_LENGTH_MAX];// in clocks
+	bool accents[PHRASE_LENGTH_MAX];
+	bool glides[PHRASE_LENGTH_MAX];
+	int length = 0;
+	float gap = GAP_NORMAL;
+};
+
+// What a phrase is generated from, read from the panel on the audio thread.
+struct MelodySettings {
+	int tonic;
+	int mode;
+	int length;
+	int accentChance;
+	int glideChance;
+	int rest;
+	float gap;
+	int firstVoice;// voices firstVoice to voices-1 get a phrase
+	int voices;
+	bool spread;
+};
+
+// One voice of the sequencer, with its own phrases and place in them. Poly mode plays several on the same clock.
+struct MelodyVoice {
+	// Playing phrase, the one to follow it and the one being generated. Handing them over swaps the pointers.
+	MelodyPhrase phrases[3];
+	MelodyPhrase *phrase = &phrases[0];
+	MelodyPhrase *nextPhrase = &phrases[1];
+	MelodyPhrase *pendingPhrase = &phrases[2];
+	bool nextPhraseReady = false;
+
+	int phrase_index = 0;
+	int passedClocks = 0;
+	int resting = 0;
+};
+
+// Octaves the poly voices are moved when spread, so they keep to the same mode in their own range.
+static const int voiceOctaves[VOICES_MAX] = {0, -1, 1, -2};
 
 struct Melody : Module {
 	enum ParamIds {
@@ -96,9 +140,9 @@ struct Melody : Module {
 		configParam(Melody::REST_PARAM, 0, REST_MAX, 2, "Clock cycle rests before starting next phrase");
 		configInput(CLOCK_INPUT, "Ext. Clock");
 		configInput(GENERATE_INPUT, "Trigger Generate");
-		configOutput(FREQ_OUTPUT, "1V/Oct");
-		configOutput(GATE_OUTPUT, "Gate");
-		configOutput(ACCENT_OUTPUT, "Accent");
+		configOutput(FREQ_OUTPUT, "1V/Oct (a channel per voice in poly)");
+		configOutput(GATE_OUTPUT, "Gate (a channel per voice in poly)");
+		configOutput(ACCENT_OUTPUT, "Accent (a channel per voice in poly)");
 		configBypass(CLOCK_INPUT, GATE_OUTPUT);
 		configOutput(NEW_PHRASE_OUTPUT, "Starting new phrase");
 		configOutput(START_PHRASE_OUTPUT, "Starting phrase");
@@ -111,106 +155,114 @@ struct Melody : Module {
 		configInput(CV_REST_INPUT, "Rest CV ±5V");
 
 		int init_phrase[6] = {60,62,67,65,62,60};
-		phrase.assign(init_phrase,init_phrase+6); 
-		int init_phrase_dura[6] = {2,2,2,2,2,2};
-		phraseDurations.assign(init_phrase_dura,init_phrase_dura+6);
-		int init_phrase_acc[6] = {false,false,false,false,false,false};
-		phraseAccents.assign(init_phrase_acc,init_phrase_acc+6);
-		int init_phrase_glide[6] = {false,false,false,false,false,false};
-		phraseGlides.assign(init_phrase_glide,init_phrase_glide+6);
+		for (int v = 0; v < VOICES_MAX; v++) {
+			MelodyPhrase *phrase = voices[v].phrase;
+			for (int i = 0; i < 6; i++) {
+				phrase->notes[i] = init_phrase[i] + 12 * voiceOctaves[v];
+				phrase->durations[i] = 2;
+				phrase->accents[i] = false;
+				phrase->glides[i] = false;
+			}
+			phrase->length = 6;
+		}
 
-		generator = std::mt19937_64(device());
+		// All voices get a phrase, so that turning up the number of voices later has something to play.
+		MelodySettings settings = this->readSettings();
+		settings.voices = VOICES_MAX;
+		for (int v = 0; v < VOICES_MAX; v++) {
+			this->generateMelody(voices[v].nextPhrase, settings, v);
+			voices[v].nextPhraseReady = true;
+		}
+		rest_amount = settings.rest;
+		seed = rng.seed;
 
-		this->generateMelody();
+		worker = std::thread(&Melody::work, this);
 	}
 
-	json_t *dataToJson() override {
-	    json_t *root = json_object();
+	~Melody() {
+		{
+			std::lock_guard<std::mutex> lock(workerMutex);
+			workerStop = true;
+		}
+		workerWake.notify_one();
+		worker.join();
+	}
 
+	// The first voice is saved at the root like in mono mode, the other voices in their own objects.
+	void phraseToJson(json_t *root, const MelodyPhrase *phrase) {
 	    json_t *sequence_json_array = json_array();
-	    for(int note : phrase) {
-	        json_array_append_new(sequence_json_array, json_integer(note));
-	    }
-	    json_object_set(root, "sequence", sequence_json_array);
-	    json_decref(sequence_json_array);
-
 	    json_t *durations_json_array = json_array();
-	    for(int dura : phraseDurations) {
-	        json_array_append_new(durations_json_array, json_integer(dura));
-	    }
-	    json_object_set(root, "durations", durations_json_array);
-	    json_decref(durations_json_array);
-
 	    json_t *accents_json_array = json_array();
-	    for(bool acc : phraseAccents) {
-	        json_array_append_new(accents_json_array, json_boolean(acc));
-	    }
-	    json_object_set(root, "accents", accents_json_array);
-	    json_decref(accents_json_array);
-
 	    json_t *glides_json_array = json_array();
-	    for(bool glide : phraseGlides) {
-	        json_array_append_new(glides_json_array, json_boolean(glide));
+	    for(int i = 0; i < phrase->length; i++) {
+	        json_array_append_new(sequence_json_array, json_integer(phrase->notes[i]));
+	        json_array_append_new(durations_json_array, json_integer(phrase->durations[i]));
+	        json_array_append_new(accents_json_array, json_boolean(phrase->accents[i]));
+	        json_array_append_new(glides_json_array, json_boolean(phrase->glides[i]));
 	    }
-	    json_object_set(root, "glides", glides_json_array);
-	    json_decref(glides_json_array);
-
-	    json_object_set_new(root, "gap", json_real(gap));
+	    json_object_set_new(root, "sequence", sequence_json_array);
+	    json_object_set_new(root, "durations", durations_json_array);
+	    json_object_set_new(root, "accents", accents_json_array);
+	    json_object_set_new(root, "glides", glides_json_array);
 
-	    json_object_set_new(root, "rest", json_integer(rest_amount));
-
-	    return root;
+	    json_object_set_new(root, "gap", json_real(phrase->gap));
 	}
 
-	void dataFromJson(json_t *root) override
-	{
+	// Returns false if the phrase is missing or broken, then the loaded phrase is left with length 0.
+	bool phraseFromJson(json_t *root, MelodyPhrase &loaded) {
+	    loaded.length = 0;
 	    json_t *sequence_json_array = json_object_get(root, "sequence");
-	    if(sequence_json_array) {
-			phrase.resize(0);
-			size_t i;
-			json_t *json_int;
-
-			json_array_foreach(sequence_json_array, i, json_int) {
-			    phrase.push_back(json_integer_value(json_int));
+	    json_t *durations_json_array = json_object_get(root, "durations");
+	    json_t *accents_json_array = json_object_get(root, "accents");
+	    json_t *glides_json_array = json_object_get(root, "glides");
+	    if(sequence_json_array && durations_json_array && accents_json_array && glides_json_array) {
+			loaded.length = json_array_size(sequence_json_array);
+			if (json_array_size(durations_json_array) != size_t(loaded.length) || json_array_size(accents_json_array) != size_t(loaded.length) || json_array_size(glides_json_array) != size_t(loaded.length) || loaded.length > PHRASE_LENGTH_MAX) {
+				loaded.length = 0;
+			}
+			for (int i = 0; i < loaded.length; i++) {
+			    loaded.notes[i] = json_integer_value(json_array_get(sequence_json_array, i));
+			    loaded.durations[i] = json_integer_value(json_array_get(durations_json_array, i));
+			    loaded.accents[i] = json_boolean_value(json_array_get(accents_json_array, i));
+			    loaded.glides[i] = json_boolean_value(json_array_get(glides_json_array, i));
 			}
 	    }
 
-	    json_t *durations_json_array = json_object_get(root, "durations");
-	    if(durations_json_array) {
-			phraseDurations.resize(0);
-			size_t i;
-			json_t *json_int;
+	    json_t *ext = json_object_get(root, "gap");
+		if (ext) {
+			loaded.gap = float(json_real_value(ext));
+		}
+		return loaded.length >= PHRASE_LENGTH_MIN;
+	}
 
-			json_array_foreach(durations_json_array, i, json_int) {
-			    phraseDurations.push_back(json_integer_value(json_int));
-			}
-	    }
+	json_t *dataToJson() override {
+	    json_t *root = json_object();
 
-	    json_t *accents_json_array = json_object_get(root, "accents");
-	    if(accents_json_array) {
-			phraseAccents.resize(0);
-			size_t i;
-			json_t *json_bool;
+	    phraseToJson(root, voices[0].phrase);
 
-			json_array_foreach(accents_json_array, i, json_bool) {
-			    phraseAccents.push_back(json_boolean_value(json_bool));
-			}
-	    }
+	    json_object_set_new(root, "rest", json_integer(rest_amount));
 
-	    json_t *glides_json_array = json_object_get(root, "glides");
-	    if(glides_json_array) {
-			phraseGlides.resize(0);
-			size_t i;
-			json_t *json_bool;
+	    json_object_set_new(root, "seed", json_integer((json_int_t) seed.load()));
 
-			json_array_foreach(glides_json_array, i, json_bool) {
-			    phraseGlides.push_back(json_boolean_value(json_bool));
-			}
+	    json_object_set_new(root, "voices", json_integer(voiceCount));
+	    json_object_set_new(root, "spread", json_boolean(spread));
+	    json_t *voices_json_array = json_array();
+	    for (int v = 1; v < voiceCount; v++) {
+	        json_t *voice_json = json_object();
+	        phraseToJson(voice_json, voices[v].phrase);
+	        json_array_append_new(voices_json_array, voice_json);
 	    }
+	    json_object_set_new(root, "voicePhrases", voices_json_array);
 
-	    json_t *ext = json_object_get(root, "gap");
-		if (ext) {
-			gap = float(json_real_value(ext));
+	    return root;
+	}
+
+	void dataFromJson(json_t *root) override
+	{
+		json_t *seedJ = json_object_get(root, "seed");
+		if (seedJ) {
+			seed = (uint64_t) json_integer_value(seedJ);
+			reseed = true;
 		}
 
 		json_t *ext2 = json_object_get(root, "rest");
@@ -218,18 +270,47 @@ struct Melody : Module {
 			rest_amount = json_integer_value(ext2);
 		}
 
-		if (phraseDurations.size() != phrase.size() || phraseAccents.size() != phrase.size() || phraseGlides.size() != phrase.size() || phrase.size() < PHRASE_LENGTH_MIN) {
-			// Illegal Json, we generate new phrase instead
-	    	this->generateMelody();
-	    	phrase_length = fmin(phrase.size(), phraseDurations.size());// fmin to prevent index being bigger than any of the vectors.
+		json_t *ext3 = json_object_get(root, "voices");
+		if (ext3) {
+			voiceCount = clamp((int) json_integer_value(ext3), 1, VOICES_MAX);
+		}
+		json_t *ext4 = json_object_get(root, "spread");
+		if (ext4) {
+			spread = json_boolean_value(ext4);
+		}
+
+	    // Read into a spare phrase first, so a broken patch file leaves the playing phrase alone.
+	    bool broken = false;
+	    MelodyPhrase loaded;
+	    if (phraseFromJson(root, loaded)) {
+	    	*voices[0].phrase = loaded;
 	    } else {
-	    	phrase_length = phrase.size();
-	    	nextPhrase.resize(0);// else it will switch to constructor generated one, right after loading json.
-	    	nextPhraseDurations.resize(0);
-	    	nextPhraseAccents.resize(0);
-	    	nextPhraseGlides.resize(0);
+	    	broken = true;
+	    }
+	    json_t *voices_json_array = json_object_get(root, "voicePhrases");
+	    for (int v = 1; v < voiceCount; v++) {
+	    	json_t *voice_json = voices_json_array ? json_array_get(voices_json_array, v - 1) : NULL;
+	    	if (voice_json && phraseFromJson(voice_json, loaded)) {
+	    		*voices[v].phrase = loaded;
+	    	} else {
+	    		broken = true;
+	    	}
+	    }
+		// The next phrases made from the constructor's seed are dropped, and the voices that were not saved are
+		// generated again from the loaded seed. That way raising the voice count later plays what the seed gives.
+		// Illegal Json, we generate the saved voices too.
+	    for (int v = 0; v < VOICES_MAX; v++) {
+	    	voices[v].nextPhraseReady = false;
+	    }
+	    MelodySettings settings = this->readSettings();
+	    settings.firstVoice = broken ? 0 : voiceCount;
+	    settings.voices = VOICES_MAX;
+	    this->requestPhrase(settings);
+	    for (int v = 0; v < VOICES_MAX; v++) {
+	    	voices[v].phrase_index = 0;
+	    	voices[v].passedClocks = 0;
+	    	voices[v].resting = 0;
 	    }
-	    phrase_index = 0;
 	}
 
 	int c4 = 60;
@@ -249,40 +330,62 @@ struct Melody : Module {
 												{2,2,3,2,3}       //   Major Pentatonic
 											  };
 
-	int phrase_length = 6;
-	int next_phrase_length = 0;
-
-	std::vector<int> phrase;
-	std::vector<int> nextPhrase;
-	std::vector<int> phraseDurations;
-	std::vector<int> nextPhraseDurations;
-	std::vector<bool> phraseAccents;
-	std::vector<bool> nextPhraseAccents;
-	std::vector<bool> phraseGlides;
-	std::vector<bool> nextPhraseGlides;
-	
-	int phrase_index = 0;
+	MelodyVoice voices[VOICES_MAX];
+	int voiceCount = 1;// Poly mode if more than 1, output channels are the voices.
+	int activeVoices = 1;
+	bool spread = true;// Poly voices in separate octaves.
+
+	// Phrases are generated on a worker thread, so the audio thread never runs the generator.
+	// Each flag hands its data over to the other thread and back, one writer at a time.
+	std::thread worker;
+	std::mutex workerMutex;
+	std::condition_variable workerWake;
+	std::atomic<bool> workerStop {false};
+	MelodySettings requestedSettings;
+	std::atomic<bool> requested {false};// requestedSettings belongs to the worker while set
+	int pendingFirstVoice = 0;
+	int pendingVoices = 0;
+	std::atomic<bool> pendingReady {false};// pendingPhrase of voices pendingFirstVoice to pendingVoices-1 belong to the audio thread while set
+
+	std::atomic<bool> wakePending {false};
+
+	// Called after changing a flag the worker waits on. Getting the mutex once after the change means the worker is
+	// either waiting or has not checked yet, so the notify cannot fall between its check and its wait.
+	// The audio thread never blocks here: while the worker holds the mutex, the notify is retried on the next sample.
+	void wakeWorker() {
+		if (workerMutex.try_lock()) {
+			workerMutex.unlock();
+			wakePending = false;
+			workerWake.notify_one();
+		} else {
+			wakePending = true;
+		}
+	}
+
 	bool clockExt_prev = false;
 	long int clockCount = 0;
 	long int clockCount_last = 0;
-	int passedClocks = 0;
-	float gap = GAP_NORMAL;
-	float nextGap = gap;
 	bool generate_prev = false;
-	int resting = 0;
 	int rest_amount = 0;
 	long int stepCounter = 0;
 
 
-	std::random_device device;
-	std::mt19937_64 generator;	
+	// Only the worker draws from rng once it runs. A seed loaded from the patch is handed to it through reseed.
+	// seed is the one saved in the patch. Only the UI side writes it, so saving never reads rng while the worker uses it.
+	SeededRandom rng;
+	std::atomic<uint64_t> seed {0};
+	std::atomic<bool> reseed {false};
 
 	//float note2freq (int note);
 	//float freq2vPoct (float freq);
 	float note2vPoct (int note);
 	int getSemiNoteOffset (int steps, int referenceIndex, std::vector<int> mode);
 	//int getModeIndex (int note, int reference, int referenceIndex, std::vector<int> mode);
-	void generateMelody ();
+	MelodySettings readSettings ();
+	void requestPhrase ();
+	void requestPhrase (const MelodySettings& settings);
+	void work ();
+	void generateMelody (MelodyPhrase* into, const MelodySettings& settings, int voice);
 	//int attenuvertInt(int CV, int KNOB, float min_result, float max_result);
 	void attenuvert(int CV, int KNOB, float min_result, float max_result);
 	void attenuvertFloat(int CV, int KNOB, float min_result, float max_result);
@@ -298,13 +401,29 @@ struct Melody : Module {
 	}
 
 	void process(const ProcessArgs &args) override;
+
+	void processBypass(const ProcessArgs &args) override {
+		// A bypassed Melody lets go of the Bass, which would otherwise hold the last note it was sent.
+		if (rightExpander.module && rightExpander.module->model == modelBass) {
+			MelodyBassMessage *toBass = (MelodyBassMessage*) rightExpander.module->leftExpander.producerMessage;
+			toBass->gate = false;
+			toBass->accent = false;
+			rightExpander.module->leftExpander.requestMessageFlip();
+		}
+		Module::processBypass(args);
+	}
 };
 
 void Melody::process(const ProcessArgs &args) {
 	// VCV Rack audio rate is +-5V
 	// VCV Rack CV is +-5V or 0V-10V
 
-	if (!outputs[FREQ_OUTPUT].isConnected()) {
+	if (wakePending) {
+		this->wakeWorker();
+	}
+	bool bassLinked = rightExpander.module && rightExpander.module->model == modelBass;
+
+	if (!outputs[FREQ_OUTPUT].isConnected() && !bassLinked) {
 		return;
 	}
 	stepCounter++;
@@ -318,37 +437,42 @@ void Melody::process(const ProcessArgs &args) {
 	float start = 0.0f;
 	float newStart = 0.0f;
 
+	if (voiceCount != activeVoices) {
+		// Voices that are turned on start from the beginning of their phrase on the next clock.
+		for (int v = activeVoices; v < voiceCount; v++) {
+			voices[v].phrase_index = 0;
+			voices[v].passedClocks = 0;
+			voices[v].resting = 0;
+		}
+		activeVoices = voiceCount;
+	}
+
 	if (clockExt && !clockExt_prev) {
-		if (resting == 0) {
-			if (passedClocks >= phraseDurations[phrase_index]-1) {
-				passedClocks = 0;
-				phrase_index++;
+		for (int v = 0; v < activeVoices; v++) {
+			MelodyVoice &voice = voices[v];
+			if (voice.resting == 0) {
+				if (voice.passedClocks >= voice.phrase->durations[voice.phrase_index]-1) {
+					voice.passedClocks = 0;
+					voice.phrase_index++;
+				} else {
+					voice.passedClocks++;
+				}
 			} else {
-				passedClocks++;
+				voice.resting--;
 			}
-		} else {
-			resting--;
-		}
-		if (phrase_index > phrase_length - 1) {
-			start = 10.0f;
-			phrase_index = 0;
-			if(nextPhrase.size() > 0) {
-				newStart = 10.0f;
-				// Switching to next phrase
-				phrase.resize(0);
-				std::copy(nextPhrase.begin(), nextPhrase.end(), std::back_inserter(phrase));
-				phraseDurations.resize(0);
-				std::copy(nextPhraseDurations.begin(), nextPhraseDurations.end(), std::back_inserter(phraseDurations));
-				phraseAccents.resize(0);
-				std::copy(nextPhraseAccents.begin(), nextPhraseAccents.end(), std::back_inserter(phraseAccents));
-				phraseGlides.resize(0);
-				std::copy(nextPhraseGlides.begin(), nextPhraseGlides.end(), std::back_inserter(phraseGlides));
-				phrase_length = next_phrase_length;
-				nextPhrase.resize(0);
-				gap = nextGap;
-			}
-			if (rest_amount > 0) {
-				resting = rest_amount;
+			if (voice.phrase_index > voice.phrase->length - 1) {
+				// The phrase outputs follow the first voice.
+				if (v == 0) start = 10.0f;
+				voice.phrase_index = 0;
+				if(voice.nextPhraseReady) {
+					if (v == 0) newStart = 10.0f;
+					// Switching to next phrase
+					std::swap(voice.phrase, voice.nextPhrase);
+					voice.nextPhraseReady = false;
+				}
+				if (rest_amount > 0) {
+					voice.resting = rest_amount;
+				}
 			}
 		}
 		clockCount_last = clockCount;
@@ -374,32 +498,128 @@ void Melody::process(const ProcessArgs &args) {
 	}
 
 	if (generate && !generate_prev) {
-		this->generateMelody();
+		this->requestPhrase();
+	}
+	if (pendingReady) {
+		// Worker has finished the phrases, they replace any next phrase not started yet.
+		// Voices that are turned off take theirs as the phrase they start with when turned on.
+		for (int v = pendingFirstVoice; v < pendingVoices; v++) {
+			if (v < activeVoices) {
+				std::swap(voices[v].nextPhrase, voices[v].pendingPhrase);
+				voices[v].nextPhraseReady = true;
+			} else {
+				std::swap(voices[v].phrase, voices[v].pendingPhrase);
+				voices[v].nextPhraseReady = false;
+			}
+		}
+		pendingReady = false;
+		this->wakeWorker();
 	}
 
-	float out = this->note2vPoct(phrase[phrase_index]);
-	if (!phraseGlides[phrase_index] || passedClocks > 0) {
-		if (resting == 0) {
-			// Only if not between phrase do we set voltage, so that previous voltage can be allowed to 'decay' if envelope is put on output.
-			outputs[FREQ_OUTPUT].setVoltage(out);
+	outputs[FREQ_OUTPUT].setChannels(activeVoices);
+	outputs[ACCENT_OUTPUT].setChannels(activeVoices);
+	outputs[GATE_OUTPUT].setChannels(activeVoices);
+	for (int v = 0; v < activeVoices; v++) {
+		MelodyVoice &voice = voices[v];
+		MelodyPhrase *phrase = voice.phrase;
+		int phrase_index = voice.phrase_index;
+		float gap = phrase->gap;
+		float out = this->note2vPoct(phrase->notes[phrase_index]);
+		float glideTime = fmin(float(double(clockCount_last)*gap), GLIDE_MAXIMUM/args.sampleTime);// in samples
+		if (!phrase->glides[phrase_index] || voice.passedClocks > 0) {
+			if (voice.resting == 0) {
+				// Only if not between phrase do we set voltage, so that previous voltage can be allowed to 'decay' if envelope is put on output.
+				outputs[FREQ_OUTPUT].setVoltage(out, v);
+			}
+		} else {
+			int phrase_index_prev = phrase_index - 1;
+			if (phrase_index_prev < 0) phrase_index_prev = phrase->length - 1;
+			float out_prev = this->note2vPoct(phrase->notes[phrase_index_prev]);
+			outputs[FREQ_OUTPUT].setVoltage(clampSafe(rescale(clockCount, 0, glideTime, out_prev, out), out_prev, out), v);// 60ms glide at start of note
+		}
+		bool accent = phrase->accents[phrase_index];
+		bool gate = !(voice.resting > 0 || (clockCount > clockCount_last*gap && voice.passedClocks >= phrase->durations[phrase_index]-1));// Normal
+		outputs[ACCENT_OUTPUT].setVoltage(float(accent)*10.0f, v);
+		outputs[GATE_OUTPUT].setVoltage(gate?10.0f:0.0f, v);
+
+		if (bassLinked && v == 0) {
+			// The Bass gets the note events of the first voice directly, and does the glide itself.
+			bool tieNext;
+			if (phrase_index < phrase->length - 1) {
+				tieNext = phrase->glides[phrase_index+1];
+			} else if (rest_amount == 0) {
+				tieNext = voice.nextPhraseReady ? voice.nextPhrase->glides[0] : phrase->glides[0];
+			} else {
+				tieNext = false;
+			}
+			MelodyBassMessage *toBass = (MelodyBassMessage*) rightExpander.module->leftExpander.producerMessage;
+			toBass->pitch = out;
+			toBass->glideTime = glideTime * args.sampleTime;
+			toBass->gate = gate || (tieNext && voice.resting == 0);
+			toBass->accent = accent;
+			toBass->glide = phrase->glides[phrase_index];
+			rightExpander.module->leftExpander.requestMessageFlip();
 		}
-	} else {
-		int phrase_index_prev = phrase_index - 1;
-		if (phrase_index_prev < 0) phrase_index_prev = phrase_length - 1;
-		float out_prev = this->note2vPoct(phrase[phrase_index_prev]);
-		outputs[FREQ_OUTPUT].setVoltage(clampSafe(rescale(clockCount, 0, fmin(float(double(clockCount_last)*gap), GLIDE_MAXIMUM/args.sampleTime), out_prev, out), out_prev, out));// 60ms glide at start of note
-	}
-	outputs[ACCENT_OUTPUT].setVoltage(float(phraseAccents[phrase_index])*10.0f);
-	if (resting > 0 || (clockCount > clockCount_last*gap && passedClocks >= phraseDurations[phrase_index]-1)) {// Normal
-		outputs[GATE_OUTPUT].setVoltage(0.0f);
-	} else {
-		outputs[GATE_OUTPUT].setVoltage(10.0f);
 	}
 	clockExt_prev = clockExt;
 	generate_prev = generate;
 }
 
-void Melody::generateMelody () {
+MelodySettings Melody::readSettings () {
+	MelodySettings settings;
+	settings.tonic = int(params[TONIC_PARAM].getValue());
+	settings.mode = int(params[MODE_PARAM].getValue());
+	settings.length = int(params[PHRASE_PARAM].getValue());
+	settings.accentChance = int(params[ACCENT_PARAM].getValue());
+	settings.glideChance = int(params[GLIDE_PARAM].getValue());
+	settings.rest = int(params[REST_PARAM].getValue());
+	settings.gap = rescale(params[GAP_PARAM].getValue(), 0, 3, GAP_STACCATISSIMO, GAP_LEGATO);
+	settings.firstVoice = 0;
+	settings.voices = voiceCount;
+	settings.spread = spread;
+	return settings;
+}
+
+void Melody::requestPhrase () {
+	this->requestPhrase(this->readSettings());
+}
+
+void Melody::requestPhrase (const MelodySettings& settings) {
+	// If the worker has not picked up the last request yet, that one is kept.
+	if (requested) {
+		return;
+	}
+	requestedSettings = settings;
+	rest_amount = requestedSettings.rest;
+	requested = true;
+	this->wakeWorker();
+}
+
+void Melody::work () {
+	std::unique_lock<std::mutex> lock(workerMutex);
+	while (true) {
+		workerWake.wait(lock, [&]{ return workerStop || (requested && !pendingReady); });
+		if (workerStop) {
+			return;
+		}
+		MelodySettings settings = requestedSettings;
+		requested = false;
+		lock.unlock();
+		if (reseed) {
+			reseed = false;
+			rng.setSeed(seed);
+		}
+		for (int v = settings.firstVoice; v < settings.voices; v++) {
+			this->generateMelody(voices[v].pendingPhrase, settings, v);
+		}
+		pendingFirstVoice = settings.firstVoice;
+		pendingVoices = settings.voices;
+		pendingReady = true;
+		lock.lock();
+	}
+}
+
+void Melody::generateMelody (MelodyPhrase* into, const MelodySettings& settings, int voice) {
 	/*
 	 +Polarity determines steepness
 	 +Even chance of up or down with constraint for hitting cadence
@@ -419,19 +639,18 @@ void Melody::generateMelody () {
 
 
 	// Melody
-	int tonic = int(params[TONIC_PARAM].getValue());
-	std::vector<int> mode = modes[int(params[MODE_PARAM].getValue())];
-	next_phrase_length = int(params[PHRASE_PARAM].getValue());
+	int tonic = settings.tonic + (settings.spread ? 12 * voiceOctaves[voice] : 0);
+	std::vector<int> mode = modes[settings.mode];
+	int next_phrase_length = settings.length;
+	int n = 0;
 	int minOffset = -2;
 	int maxOffset =  4;
-	nextPhrase.resize(0);
-	nextPhrase.push_back(tonic);
+	into->notes[n++] = tonic;
 	int lastNote = tonic;
 	int lastIndex = 0;
 	int distanceToTonic = 0;
 	int closure = next_phrase_length >= PHRASE_LENGTH_THAT_DEMANDS_RESOLUTION?-1:0;
-	std::uniform_int_distribution<int> uniform_dist_e(12, 16);
-	int stepsTillEstablish = uniform_dist_e(generator);
+	int stepsTillEstablish = rng.between(12, 16);
 	//int direction = 0;
 	//std::cout << "    :::: \n";
 	//std::cout << "    :::: \n";
@@ -462,7 +681,7 @@ void Melody::generateMelody () {
 		} else if (stepsTillEstablish < next_phrase_length-i-1) {
 			// Longer phrase target establish
 			int stepsLeft  = stepsTillEstablish; // steps left including tonic step
-			if (stepsTillEstablish == 1) stepsTillEstablish = uniform_dist_e(generator);
+			if (stepsTillEstablish == 1) stepsTillEstablish = rng.between(12, 16);
 			int howFarDown = stepsLeft * minOffset; // How far towards tonic can we get from now till tonic (negative number)
 			int howFarUp   = stepsLeft * maxOffset;
 			int maxUp   = minOffset-(distanceToTonic+howFarDown);
@@ -483,10 +702,9 @@ void Melody::generateMelody () {
 		int maxiRand =  maxOffset;
 		int miniRand = -maxOffset;
 		//maxiRand = std::min(miniRand+1, direction>2?-1:maxiRand);
-		std::uniform_int_distribution<int> uniform_dist(miniRand, maxiRand);
-		int noteOffset = clamp(uniform_dist(generator), minClamp, maxClamp);// min + (rand() % static_cast<int>(max - min + 1)) [including min and max]
+		int noteOffset = clamp(rng.between(miniRand, maxiRand), minClamp, maxClamp);// min + (rand() % static_cast<int>(max - min + 1)) [including min and max]
 		int note = lastNote + getSemiNoteOffset(noteOffset, lastIndex, mode);
-		nextPhrase.push_back(note);
+		into->notes[n++] = note;
 		distanceToTonic += noteOffset;
 		lastNote = note;
 		lastIndex += noteOffset;
@@ -496,34 +714,27 @@ void Melody::generateMelody () {
 		stepsTillEstablish--;
 	}
 	if (closure == -1) {
-		nextPhrase.push_back(tonic);
+		into->notes[n++] = tonic;
 	}
 
 	// Durations
-	nextPhraseDurations.resize(0);
 	for (int i = 0; i < next_phrase_length; i++) {
-		nextPhraseDurations.push_back(1+(rand() % static_cast<int>(2+1)));
+		into->durations[i] = 1+rng.below(2+1);
 	}
 
 	// Accents
-	float chance = int(params[ACCENT_PARAM].getValue());
-	nextPhraseAccents.resize(0);
 	for (int i = 0; i < next_phrase_length; i++) {
-		nextPhraseAccents.push_back((rand() % static_cast<int>(100+1)) < int(chance));
+		into->accents[i] = rng.below(100+1) < settings.accentChance;
 	}
 
 	// Glides
-	float chance_g = int(params[GLIDE_PARAM].getValue());
-	nextPhraseGlides.resize(0);
 	for (int i = 0; i < next_phrase_length; i++) {
-		nextPhraseGlides.push_back((rand() % static_cast<int>(100+1)) < int(chance_g));
+		into->glides[i] = rng.below(100+1) < settings.glideChance;
 	}
 
-	// Rest
-	rest_amount = int(params[REST_PARAM].getValue());
-
 	// Gaps
-	nextGap = rescale(params[GAP_PARAM].getValue(), 0, 3, GAP_STACCATISSIMO, GAP_LEGATO);
+	into->gap = settings.gap;
+	into->length = next_phrase_length;
 	/*switch(int(params[GAP_PARAM].getValue())) {
 		case 0:
 			nextGap = GAP_STACCATO;
@@ -629,6 +840,43 @@ float Melody::note2vPoct (int note) {
 	return float(note-c4) / 12.0f;
 }
 
+struct VoicesMelodyMenuItem : MenuItem {
+	Melody* _module;
+	int _voices;
+
+	VoicesMelodyMenuItem(Melody* module, const char* label, int voices)
+	: _module(module), _voices(voices)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->voiceCount = _voices;
+	}
+
+	void step() override {
+		rightText = _module->voiceCount == _voices ? "✔" : "";
+	}
+};
+
+struct SpreadMelodyMenuItem : MenuItem {
+	Melody* _module;
+
+	SpreadMelodyMenuItem(Melody* module, const char* label)
+	: _module(module)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->spread = !_module->spread;
+	}
+
+	void step() override {
+		rightText = _module->spread ? "✔" : "";
+	}
+};
+
 struct MelodyWidget : ModuleWidget {
 	MelodyWidget(Melody *module) {
 		setModule(module);
@@ -672,6 +920,18 @@ struct MelodyWidget : ModuleWidget {
 		addOutput(createOutput<OutPortAutinn>(Vec(16 * RACK_GRID_WIDTH*0.55-HALF_PORT, 320), module, Melody::ACCENT_OUTPUT));
 		addOutput(createOutput<OutPortAutinn>(Vec(16 * RACK_GRID_WIDTH*0.75-HALF_PORT, 320), module, Melody::GATE_OUTPUT));
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Melody* a = dynamic_cast<Melody*>(module);
+		assert(a);
+
+		menu->addChild(new MenuLabel());
+		menu->addChild(new VoicesMelodyMenuItem(a, "Mono", 1));
+		menu->addChild(new VoicesMelodyMenuItem(a, "Poly: 2 voices", 2));
+		menu->addChild(new VoicesMelodyMenuItem(a, "Poly: 3 voices", 3));
+		menu->addChild(new VoicesMelodyMenuItem(a, "Poly: 4 voices", 4));
+		menu->addChild(new SpreadMelodyMenuItem(a, "Poly voices in separate octaves (from next generate)"));
+	}
 };
 
 Model *modelMelody = createModel<Melody, MelodyWidget>("Melody");
\ No newline at end of file
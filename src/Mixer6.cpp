@@ -23,9 +23,271 @@
 **/
 
 const static int num_mono_channels = 6;
+const static int control_rate = 32;// samples between reading knobs and buttons
+const static int num_busses = 3;// main and the two subgroups
+const static int num_sends = 2;// FX A and B
+const static int max_compensation = 15;// expanders in a chain that get delay compensated
 
-struct Mixer6 : Module {
-	enum ParamIds {
+// The strips summed onto the busses.
+struct MixerSums {
+	float left[num_busses] = {};
+	float right[num_busses] = {};
+	float sendLeft[num_sends] = {};// for mono sends left and right are equal, except with stereo input
+	float sendRight[num_sends] = {};
+
+	void add(const MixerSums &other) {
+		for (int b = 0; b < num_busses; b++) {
+			left[b]  += other.left[b];
+			right[b] += other.right[b];
+		}
+		for (int f = 0; f < num_sends; f++) {
+			sendLeft[f]  += other.sendLeft[f];
+			sendRight[f] += other.sendRight[f];
+		}
+	}
+};
+
+// A gain per lane that moves linearly to its target across a control block, so knob moves do not zipper.
+struct RampedGain {
+	simd::float_4 value = 0.0f;
+	simd::float_4 target = 0.0f;
+	simd::float_4 delta = 0.0f;
+
+	void start(int samples) {
+		delta = (target - value) / (float) samples;
+	}
+
+	void step(bool last) {
+		value = last ? target : value + delta;
+	}
+};
+
+// The channel strips: EQ, pan, level and sends.
+// The channels are processed 4 at a time in SIMD lanes, knobs are turned into per lane coefficients and gains at control rate.
+template <int CHANNELS>
+struct MixerStrips {
+	static const int GROUPS = (CHANNELS + 3) / 4;
+
+	const float Gd = 30.0f;
+	const float Pm = 30.0f;
+	const float Qp = 0.40f;
+	const float Qs = 0.707107f;
+	const float c1 = 250.0f;
+	const float c2 = 700.0f;
+	const float c3 = 2000.0f;
+
+	BiquadFilter4 lowS[GROUPS];
+	BiquadFilter4 midP[GROUPS];
+	BiquadFilter4 highS[GROUPS];
+	BiquadFilter4 lowS_R[GROUPS];// right side, only used for stereo input
+	BiquadFilter4 midP_R[GROUPS];
+	BiquadFilter4 highS_R[GROUPS];
+
+	simd::float_4 flat[GROUPS];// 1 in lanes where EQ is neutral, they get the input passed through
+	RampedGain gainLeft[num_busses][GROUPS];
+	RampedGain gainRight[num_busses][GROUPS];
+	RampedGain gainSendLeft[num_sends][GROUPS];
+	RampedGain gainSendRight[num_sends][GROUPS];
+	int bus[CHANNELS];
+	int busses = 1;// only the busses up to the highest one in use are summed
+	int bussesNext = 1;// the busses in use once the ramp is done, a bus that was left is ramped down first
+	int ramp = 0;// samples left of the gain ramp
+
+	float low_prev[CHANNELS];
+	float mid_prev[CHANNELS];
+	float high_prev[CHANNELS];
+	float rate_prev = -1.0f;
+
+	MixerStrips() {
+		for (int g = 0; g < GROUPS; g++) {
+			flat[g] = 1.0f;
+		}
+		std::fill_n(bus, CHANNELS, 0);
+		std::fill_n(low_prev, CHANNELS, -1.0f);
+		std::fill_n(mid_prev, CHANNELS, -1.0f);
+		std::fill_n(high_prev, CHANNELS, -1.0f);
+	}
+
+	// control rate:
+	void setEQ(int ch, float low, float mid, float high, float rate) {
+		int g = ch / 4;
+		int lane = ch % 4;
+		if (low != low_prev[ch] || mid != mid_prev[ch] || high != high_prev[ch] || rate != rate_prev) {
+			lowS[g].setParameters(lane, dsp::BiquadFilter::LOWSHELF, c1/rate, Qs, low);
+			midP[g].setParameters(lane, dsp::BiquadFilter::PEAK, c2/rate, Qp, mid);
+			highS[g].setParameters(lane, dsp::BiquadFilter::HIGHSHELF, c3/rate, Qs, high);
+			lowS_R[g].setParameters(lane, dsp::BiquadFilter::LOWSHELF, c1/rate, Qs, low);
+			midP_R[g].setParameters(lane, dsp::BiquadFilter::PEAK, c2/rate, Qp, mid);
+			highS_R[g].setParameters(lane, dsp::BiquadFilter::HIGHSHELF, c3/rate, Qs, high);
+		}
+		low_prev[ch] = low;
+		mid_prev[ch] = mid;
+		high_prev[ch] = high;
+		flat[g][lane] = (low == Pm && mid == Pm && high == Pm) ? 1.0f : 0.0f;
+	}
+
+	// control rate, pan is 0 to PI/2, toBus is 0 for main or the subgroup.
+	// Stereo sends follow the pan knob, scaled so center is at unity on both sides:
+	void setGains(int ch, int toBus, float level, float pan, const float* send, bool stereoSends) {
+		int g = ch / 4;
+		int lane = ch % 4;
+		gainLeft[bus[ch]][g].target[lane]  = 0.0f;
+		gainRight[bus[ch]][g].target[lane] = 0.0f;
+		gainLeft[toBus][g].target[lane]  = cos(pan) * level;
+		gainRight[toBus][g].target[lane] = sin(pan) * level;
+		for (int f = 0; f < num_sends; f++) {
+			gainSendLeft[f][g].target[lane]  = stereoSends ? send[f] * M_SQRT2 * cos(pan) : send[f];
+			gainSendRight[f][g].target[lane] = stereoSends ? send[f] * M_SQRT2 * sin(pan) : send[f];
+		}
+		bus[ch] = toBus;
+		bussesNext = 1 + *std::max_element(bus, bus + CHANNELS);
+	}
+
+	// control rate, after the gains of all channels are set. The gains reach their targets at the end of the block:
+	void startRamp(int samples) {
+		for (int g = 0; g < GROUPS; g++) {
+			for (int b = 0; b < num_busses; b++) {
+				gainLeft[b][g].start(samples);
+				gainRight[b][g].start(samples);
+			}
+			for (int f = 0; f < num_sends; f++) {
+				gainSendLeft[f][g].start(samples);
+				gainSendRight[f][g].start(samples);
+			}
+		}
+		busses = std::max(busses, bussesNext);
+		ramp = samples;
+	}
+
+	// audio rate
+	void stepRamp() {
+		if (ramp == 0) {
+			return;
+		}
+		ramp--;
+		bool last = ramp == 0;
+		for (int g = 0; g < GROUPS; g++) {
+			for (int b = 0; b < num_busses; b++) {
+				gainLeft[b][g].step(last);
+				gainRight[b][g].step(last);
+			}
+			for (int f = 0; f < num_sends; f++) {
+				gainSendLeft[f][g].step(last);
+				gainSendRight[f][g].step(last);
+			}
+		}
+		if (last) {
+			busses = bussesNext;
+		}
+	}
+
+	simd::float_4 equalize(int g, simd::float_4 x) {
+		simd::float_4 eq = (lowS[g].process(x) + midP[g].process(x) + highS[g].process(x)) / Gd;
+		eq = simd::ifelse(simd::abs(eq) < INFINITY, eq, 0.0f);
+		return simd::ifelse(flat[g] != 0.0f, x, eq);
+	}
+
+	simd::float_4 equalizeRight(int g, simd::float_4 x) {
+		simd::float_4 eq = (lowS_R[g].process(x) + midP_R[g].process(x) + highS_R[g].process(x)) / Gd;
+		eq = simd::ifelse(simd::abs(eq) < INFINITY, eq, 0.0f);
+		return simd::ifelse(flat[g] != 0.0f, x, eq);
+	}
+
+	// audio rate, in and direct must hold GROUPS*4 samples, direct gets the post EQ signal of each channel:
+	void process(const float* in, float* direct, MixerSums &sums) {
+		simd::float_4 sumLeft[num_busses];
+		simd::float_4 sumRight[num_busses];
+		simd::float_4 sumSendLeft[num_sends];
+		simd::float_4 sumSendRight[num_sends];
+		stepRamp();
+		clear(sumLeft, sumRight, sumSendLeft, sumSendRight);
+		for (int g = 0; g < GROUPS; g++) {
+			simd::float_4 out = equalize(g, simd::float_4::load(in + g * 4));
+			out.store(direct + g * 4);
+			for (int b = 0; b < busses; b++) {
+				sumLeft[b]  += gainLeft[b][g].value * out;
+				sumRight[b] += gainRight[b][g].value * out;
+			}
+			for (int f = 0; f < num_sends; f++) {
+				sumSendLeft[f]  += gainSendLeft[f][g].value * out;
+				sumSendRight[f] += gainSendRight[f][g].value * out;
+			}
+		}
+		sum(sumLeft, sumRight, sumSendLeft, sumSendRight, sums);
+	}
+
+	// audio rate, stereo input where the pan knob works as balance, mono sends and direct get the middle:
+	void process(const float* inLeft, const float* inRight, float* direct, MixerSums &sums) {
+		simd::float_4 sumLeft[num_busses];
+		simd::float_4 sumRight[num_busses];
+		simd::float_4 sumSendLeft[num_sends];
+		simd::float_4 sumSendRight[num_sends];
+		stepRamp();
+		clear(sumLeft, sumRight, sumSendLeft, sumSendRight);
+		for (int g = 0; g < GROUPS; g++) {
+			simd::float_4 outLeft  = equalize(g, simd::float_4::load(inLeft + g * 4));
+			simd::float_4 outRight = equalizeRight(g, simd::float_4::load(inRight + g * 4));
+			simd::float_4 mid = (outLeft + outRight) * 0.5f;
+			mid.store(direct + g * 4);
+			for (int b = 0; b < busses; b++) {
+				sumLeft[b]  += gainLeft[b][g].value * outLeft;
+				sumRight[b] += gainRight[b][g].value * outRight;
+			}
+			for (int f = 0; f < num_sends; f++) {
+				sumSendLeft[f]  += gainSendLeft[f][g].value * outLeft;
+				sumSendRight[f] += gainSendRight[f][g].value * outRight;
+			}
+		}
+		sum(sumLeft, sumRight, sumSendLeft, sumSendRight, sums);
+	}
+
+	void clear(simd::float_4* sumLeft, simd::float_4* sumRight, simd::float_4* sumSendLeft, simd::float_4* sumSendRight) {
+		for (int b = 0; b < busses; b++) {
+			sumLeft[b]  = 0.0f;
+			sumRight[b] = 0.0f;
+		}
+		for (int f = 0; f < num_sends; f++) {
+			sumSendLeft[f]  = 0.0f;
+			sumSendRight[f] = 0.0f;
+		}
+	}
+
+	void sum(const simd::float_4* sumLeft, const simd::float_4* sumRight, const simd::float_4* sumSendLeft, const simd::float_4* sumSendRight, MixerSums &sums) {
+		for (int b = 0; b < num_busses; b++) {
+			sums.left[b]  = b < busses ? sumLeft[b][0]  + sumLeft[b][1]  + sumLeft[b][2]  + sumLeft[b][3]  : 0.0f;
+			sums.right[b] = b < busses ? sumRight[b][0] + sumRight[b][1] + sumRight[b][2] + sumRight[b][3] : 0.0f;
+		}
+		for (int f = 0; f < num_sends; f++) {
+			sums.sendLeft[f]  = sumSendLeft[f][0]  + sumSendLeft[f][1]  + sumSendLeft[f][2]  + sumSendLeft[f][3];
+			sums.sendRight[f] = sumSendRight[f][0] + sumSendRight[f][1] + sumSendRight[f][2] + sumSendRight[f][3];
+		}
+	}
+};
+
+// Passed along a chain of a Mixer6 with expanders to its right.
+struct MixerChainMessage {
+	MixerSums sums;// sent to the left: the sending module and the expanders further right
+	bool solo = false;// a channel is soloed somewhere on the sending side of the chain
+	bool busPatched[num_busses] = {true, false, false};// sent to the right: which subgroups have their output connected
+	bool stereoSends = false;// sent to the right: the mixer has stereo FX sends
+	int position = 0;// sent to the right: the position of the receiver in the chain, the mixer is 0
+	int last = 0;// sent to the left: the position of the last expander in the chain
+	float direct[PORT_MAX_CHANNELS] = {};// sent to the left: direct of the expander channels, by channel number counted from the mixer
+};
+
+// Sent from a Mixer6 to the outputs module on its left.
+struct MixerOutputMessage {
+	float direct[PORT_MAX_CHANNELS] = {};// the mixer channels followed by the expander channels
+	int directChannels = num_mono_channels;
+	float left[num_busses] = {};
+	float right[num_busses] = {};
+};
+
+// What the mixer and its expanders have in common: 6 channel strips with mute/solo.
+// The strip params and inputs come first on both, the mute buttons and lights are placed by each module,
+// as the mixer has its own params in front of the mute buttons.
+struct Mixer6Channels : Module {
+	enum StripParamIds {
 		ENUMS(LOW_PARAM, num_mono_channels),
 		ENUMS(MID_PARAM, num_mono_channels),
 		ENUMS(HIGH_PARAM, num_mono_channels),
@@ -33,15 +295,136 @@ struct Mixer6 : Module {
 		ENUMS(PAN_PARAM, num_mono_channels),
 		ENUMS(FX_A_SEND_PARAM, num_mono_channels),
 		ENUMS(FX_B_SEND_PARAM, num_mono_channels),
-		FX_A_TO_MAIN_PARAM,
+		NUM_STRIP_PARAMS
+	};
+	enum StripInputIds {
+		ENUMS(INPUT,num_mono_channels),
+		NUM_STRIP_INPUTS
+	};
+
+	const int muteButtonParam;
+	const int muteLight;
+
+	MixerStrips<num_mono_channels> strips;
+	const float Pm = strips.Pm;
+
+	int mute_solo_state[num_mono_channels];// -1: mute  0: norm  +1: solo
+	bool mute_solo_button_prev[num_mono_channels];
+	bool solo = false;// a channel on this module is soloed
+	bool soloChain = false;// a channel on another module in the chain is soloed
+
+	bool spread = false;// spread the voices of poly inputs across the stereo field
+
+	int subgroup[num_mono_channels];// 0: main  1-2: subgroup, channels fall back to main if their subgroup output is not connected
+	bool busPatched[num_busses] = {true, false, false};
+
+	bool stereoSends = false;// the FX sends are poly left and right, chosen on the mixer
+	float spreadLeft[PORT_MAX_CHANNELS + 1][PORT_MAX_CHANNELS];// [voices][voice]
+	float spreadRight[PORT_MAX_CHANNELS + 1][PORT_MAX_CHANNELS];
+
+	MixerChainMessage leftMessages[2];
+	MixerChainMessage rightMessages[2];
+
+	int position = 0;// in the chain, the mixer is 0
+	int last = 0;// position of the last expander in the chain
+	MixerSums sumsDelay[max_compensation + 1];
+	float directDelay[max_compensation + 1][MixerStrips<num_mono_channels>::GROUPS * 4] = {};
+	int delayIndex = 0;
+
+	unsigned short int step = 0;
+
+	Mixer6Channels(int muteButtonParam, int muteLight)
+	: muteButtonParam(muteButtonParam), muteLight(muteLight)
+	{
+		leftExpander.producerMessage  = &leftMessages[0];
+		leftExpander.consumerMessage  = &leftMessages[1];
+		rightExpander.producerMessage = &rightMessages[0];
+		rightExpander.consumerMessage = &rightMessages[1];
+		std::fill_n(mute_solo_button_prev, num_mono_channels, false);
+		std::fill_n(mute_solo_state, num_mono_channels, 0);
+		std::fill_n(subgroup, num_mono_channels, 0);
+
+		// Voices are panned evenly from hard left to hard right, scaled so a center voice is at unity on both sides.
+		for (int voices = 0; voices <= PORT_MAX_CHANNELS; voices++) {
+			for (int v = 0; v < PORT_MAX_CHANNELS; v++) {
+				float angle = voices > 1 ? M_PI * 0.5f * v / (voices - 1) : M_PI * 0.25f;
+				spreadLeft[voices][v]  = v < voices ? M_SQRT2 * cos(angle) : 0.0f;
+				spreadRight[voices][v] = v < voices ? M_SQRT2 * sin(angle) : 0.0f;
+			}
+		}
+	}
+
+	void onReset(const ResetEvent& e) override {
+		spread = false;
+		std::fill_n(subgroup, num_mono_channels, 0);
+		std::fill_n(mute_solo_state, num_mono_channels, 0);
+		Module::onReset(e);
+	}
+
+	json_t *dataToJson() override {
+	    json_t *root = json_object();
+
+	    json_t *mute_json_array = json_array();
+	    for(int state : mute_solo_state) {
+	        json_array_append_new(mute_json_array, json_integer(state));
+	    }
+	    json_object_set(root, "mute_solo", mute_json_array);
+	    json_decref(mute_json_array);
+	    json_object_set_new(root, "spread", json_boolean(spread));
+
+	    json_t *subgroup_json_array = json_array();
+	    for(int sub : subgroup) {
+	        json_array_append_new(subgroup_json_array, json_integer(sub));
+	    }
+	    json_object_set_new(root, "subgroup", subgroup_json_array);
+
+	    return root;
+	}
+
+	void dataFromJson(json_t *root) override
+	{
+	    json_t *mute_json_array = json_object_get(root, "mute_solo");
+	    if(mute_json_array) {
+			size_t i;
+			json_t *json_int;
+
+			json_array_foreach(mute_json_array, i, json_int) {
+			    mute_solo_state[i] = json_integer_value(json_int);
+			}
+	    }
+	    json_t *ext = json_object_get(root, "spread");
+	    if (ext) {
+	        spread = json_boolean_value(ext);
+	    }
+	    json_t *subgroup_json_array = json_object_get(root, "subgroup");
+	    if(subgroup_json_array) {
+			size_t i;
+			json_t *json_int;
+
+			json_array_foreach(subgroup_json_array, i, json_int) {
+			    subgroup[i] = clamp((int) json_integer_value(json_int), 0, num_busses - 1);
+			}
+	    }
+	}
+
+	void configChannels();
+	void handleMuteButtons();
+	void updateStrips(float rate);
+	void processStrips(float* direct, MixerSums &sums);
+	void compensate(MixerSums &sums, float* direct);
+	bool isExpander(Module *other);
+};
+
+struct Mixer6 : Mixer6Channels {
+	enum ParamIds {
+		FX_A_TO_MAIN_PARAM = NUM_STRIP_PARAMS,
 		FX_B_TO_MAIN_PARAM,
 		LEVEL_MAIN,
 		ENUMS(MUTE_BUTTON_PARAM, num_mono_channels),
 		NUM_PARAMS
 	};
 	enum InputIds {
-		ENUMS(INPUT,num_mono_channels),
-		FX_RETURN_L_A,
+		FX_RETURN_L_A = NUM_STRIP_INPUTS,
 		FX_RETURN_R_A,
 		FX_RETURN_L_B,
 		FX_RETURN_R_B,
@@ -65,27 +448,6 @@ struct Mixer6 : Module {
 		NUM_LIGHTS
 	};
 
-	dsp::BiquadFilter lowS[num_mono_channels];
-	dsp::BiquadFilter midP[num_mono_channels];
-	dsp::BiquadFilter highS[num_mono_channels];
-
-	
-
-	const float Gd = 30.0f;
-	const float Pm = 30.0f;
-	const float Qp = 0.40f;
-	const float Qs = 0.707107f;
-	const float c1 = 250.0f;
-	const float c2 = 700.0f;
-	const float c3 = 2000.0f;
-
-	float low_prev[num_mono_channels];
-	float mid_prev[num_mono_channels];
-	float high_prev[num_mono_channels];
-	int mute_solo_state[num_mono_channels];// -1: mute  0: norm  +1: solo
-	bool mute_solo_button_prev[num_mono_channels];
-	bool solo = false;
-
 	const float vuMaxDB = 30.0f;
 	const float intervalDB_FX = vuMaxDB/8.0f;
 	const float intervalDB_main = vuMaxDB/15.0f;
@@ -95,154 +457,233 @@ struct Mixer6 : Module {
 	dsp::VuMeter2 vuMeterFXB_R;
 	dsp::VuMeter2 vuMeterOut;
 	dsp::VuMeter2 vuMeterOut2;
-	unsigned short int step = 0;
+	simd::float_4 peakReturn = 0.0f;
+	simd::float_4 peakMain = 0.0f;
 
-	float rate_prev = -1.0f;
+	simd::float_4 returnGain = 1.0f;
+	float mainLevel = 1.0f;
 
-	Mixer6() {
+	Mixer6() : Mixer6Channels(MUTE_BUTTON_PARAM, MUTE_LIGHT) {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
-		for (int ch = 0; ch < num_mono_channels; ch++) {
-			configInput(INPUT+ch, "Channel "+std::to_string(ch+1)+" Audio");
-			configParam(HIGH_PARAM+ch, 0.5f, Pm, Pm, "Channel "+std::to_string(ch+1)+" EQ High", " dB", 0.0f, 1.0f, -Pm);
-			configParam(MID_PARAM+ch, 0.5f, Pm, Pm, "Channel "+std::to_string(ch+1)+" EQ Mid", " dB", 0.0f, 1.0f, -Pm);
-			configParam(LOW_PARAM+ch, 0.5f, Pm, Pm, "Channel "+std::to_string(ch+1)+" EQ Low", " dB", 0.0f, 1.0f, -Pm);
-			configParam(FX_A_SEND_PARAM+ch, 0.0f, 2.0f, 0.0f, "Channel "+std::to_string(ch+1)+" FX A Send", " dB", -10, 20);
-			configParam(FX_B_SEND_PARAM+ch, 0.0f, 2.0f, 0.0f, "Channel "+std::to_string(ch+1)+" FX B Send", " dB", -10, 20);
-			configParam(CHANNEL_LEVEL_PARAM+ch, 0.0f, 2.0f, 1.0f, "Channel "+std::to_string(ch+1)+" Level", " dB", -10, 20);
-			configParam(PAN_PARAM+ch, 0.0f, M_PI*0.5f, M_PI*0.25f, "Channel "+std::to_string(ch+1)+" Pan", " ", 0.0f, 2.0f/M_PI, -0.5f);
-			configLight(MUTE_LIGHT+ch*3, "Mute (red)/Solo (blue)");
-			configButton(MUTE_BUTTON_PARAM+ch, "Mute/Solo");
-		}
+		configChannels();
 		configParam(LEVEL_MAIN, 0.0f, 2.0f, 1.0f, "Main Level", " dB", -10, 20);
 		configParam(Mixer6::FX_A_TO_MAIN_PARAM, 0.0f, 2.0f, 1.0f, "FX A To Main", " dB", -10, 20);
 		configParam(Mixer6::FX_B_TO_MAIN_PARAM, 0.0f, 2.0f, 1.0f, "FX B To Main", " dB", -10, 20);
 		//configBypass(MIXER_INPUT, MIXER_OUTPUT);
 		configInput(FX_RETURN_L_A, "FX A Return Left");
 		configInput(FX_RETURN_R_A, "FX A Return Right");
-		configOutput(FX_SEND_A, "FX A Mono Send");
+		configOutput(FX_SEND_A, "FX A Send");
 		configInput(FX_RETURN_L_B, "FX B Return Left");
 		configInput(FX_RETURN_R_B, "FX B Return Right");
-		configOutput(FX_SEND_B, "FX B Mono Send");
-		configOutput(MIXER_OUTPUT_L, "Left Audio");
-		configOutput(MIXER_OUTPUT_R, "Right Audio");
+		configOutput(FX_SEND_B, "FX B Send");
+		configOutput(MIXER_OUTPUT_L, "Left Audio (delayed a sample per expander, to line up with the expander channels)");
+		configOutput(MIXER_OUTPUT_R, "Right Audio (delayed a sample per expander, to line up with the expander channels)");
+	}
 
-		std::fill_n(mute_solo_button_prev, num_mono_channels, false);
-		std::fill_n(mute_solo_state, num_mono_channels, 0);
+	void onReset(const ResetEvent& e) override {
+		stereoSends = false;
+		Mixer6Channels::onReset(e);
 	}
 
 	json_t *dataToJson() override {
-	    json_t *root = json_object();
-
-	    json_t *mute_json_array = json_array();
-	    for(int state : mute_solo_state) {
-	        json_array_append_new(mute_json_array, json_integer(state));
-	    }
-	    json_object_set(root, "mute_solo", mute_json_array);
-	    json_decref(mute_json_array);
+		json_t *root = Mixer6Channels::dataToJson();
+		json_object_set_new(root, "stereoSends", json_boolean(stereoSends));
+		return root;
+	}
 
-	    return root;
+	void dataFromJson(json_t *root) override {
+		Mixer6Channels::dataFromJson(root);
+		json_t *ext = json_object_get(root, "stereoSends");
+		if (ext) {
+			stereoSends = json_boolean_value(ext);
+		}
 	}
 
-	void dataFromJson(json_t *root) override
-	{
-	    json_t *mute_json_array = json_object_get(root, "mute_solo");
-	    if(mute_json_array) {
-			size_t i;
-			json_t *json_int;
+	void process(const ProcessArgs &args) override;
+};
 
-			json_array_foreach(mute_json_array, i, json_int) {
-			    mute_solo_state[i] = json_integer_value(json_int);
-			}
-	    }
+// Adds 6 channel strips to a Mixer6 placed to its left, directly or through other expanders.
+// Each expander in the chain delays its channels by one sample, as is the way with Rack expanders,
+// so the mixer and the expanders closer to it delay their own channels to match the last one.
+struct Mixer6Expander : Mixer6Channels {
+	enum ParamIds {
+		MUTE_BUTTON_PARAM = NUM_STRIP_PARAMS,
+		MUTE_BUTTON_PARAM_LAST = MUTE_BUTTON_PARAM + num_mono_channels - 1,
+		NUM_PARAMS
+	};
+	enum InputIds {
+		NUM_INPUTS = NUM_STRIP_INPUTS
+	};
+	enum OutputIds {
+		NUM_OUTPUTS
+	};
+	enum LightIds {
+		ENUMS(MUTE_LIGHT, 3*num_mono_channels),
+		NUM_LIGHTS
+	};
+
+	Mixer6Expander() : Mixer6Channels(MUTE_BUTTON_PARAM, MUTE_LIGHT) {
+		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+
+		configChannels();
 	}
 
-	void handleMuteButtons();
+	void process(const ProcessArgs &args) override;
+};
+
+// Direct and subgroup outputs for a Mixer6 placed to its right.
+struct Mixer6Outputs : Module {
+	enum ParamIds {
+		NUM_PARAMS
+	};
+	enum InputIds {
+		NUM_INPUTS
+	};
+	enum OutputIds {
+		DIRECT_OUTPUT,
+		SUBGROUP_1_OUTPUT,
+		SUBGROUP_2_OUTPUT,
+		NUM_OUTPUTS
+	};
+	enum LightIds {
+		NUM_LIGHTS
+	};
+
+	MixerOutputMessage rightMessages[2];
+
+	Mixer6Outputs() {
+		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
+
+		configOutput(DIRECT_OUTPUT, "Direct (post EQ, pre level), a poly channel per mixer channel, then the expander channels up to 16");
+		configOutput(SUBGROUP_1_OUTPUT, "Subgroup 1 (poly left and right)");
+		configOutput(SUBGROUP_2_OUTPUT, "Subgroup 2 (poly left and right)");
+
+		rightExpander.producerMessage = &rightMessages[0];
+		rightExpander.consumerMessage = &rightMessages[1];
+	}
 
 	void process(const ProcessArgs &args) override;
 };
 
+void Mixer6Channels::configChannels() {
+	for (int ch = 0; ch < num_mono_channels; ch++) {
+		configInput(INPUT+ch, "Channel "+std::to_string(ch+1)+" Audio");
+		configParam(HIGH_PARAM+ch, 0.5f, Pm, Pm, "Channel "+std::to_string(ch+1)+" EQ High", " dB", 0.0f, 1.0f, -Pm);
+		configParam(MID_PARAM+ch, 0.5f, Pm, Pm, "Channel "+std::to_string(ch+1)+" EQ Mid", " dB", 0.0f, 1.0f, -Pm);
+		configParam(LOW_PARAM+ch, 0.5f, Pm, Pm, "Channel "+std::to_string(ch+1)+" EQ Low", " dB", 0.0f, 1.0f, -Pm);
+		configParam(FX_A_SEND_PARAM+ch, 0.0f, 2.0f, 0.0f, "Channel "+std::to_string(ch+1)+" FX A Send", " dB", -10, 20);
+		configParam(FX_B_SEND_PARAM+ch, 0.0f, 2.0f, 0.0f, "Channel "+std::to_string(ch+1)+" FX B Send", " dB", -10, 20);
+		configParam(CHANNEL_LEVEL_PARAM+ch, 0.0f, 2.0f, 1.0f, "Channel "+std::to_string(ch+1)+" Level", " dB", -10, 20);
+		configParam(PAN_PARAM+ch, 0.0f, M_PI*0.5f, M_PI*0.25f, "Channel "+std::to_string(ch+1)+" Pan", " ", 0.0f, 2.0f/M_PI, -0.5f);
+		configLight(muteLight+ch*3, "Mute (red)/Solo (blue)");
+		configButton(muteButtonParam+ch, "Mute/Solo");
+	}
+}
+
+// Delays the sums and direct signals of this module so they reach the mixer together with those of the last expander.
+void Mixer6Channels::compensate(MixerSums &sums, float* direct) {
+	const int length = MixerStrips<num_mono_channels>::GROUPS * 4;
+	int delay = clamp(last - position, 0, max_compensation);
+	int readIndex = (delayIndex - delay + max_compensation + 1) % (max_compensation + 1);
+	sumsDelay[delayIndex] = sums;
+	std::copy_n(direct, length, directDelay[delayIndex]);
+	sums = sumsDelay[readIndex];
+	std::copy_n(directDelay[readIndex], length, direct);
+	delayIndex = (delayIndex + 1) % (max_compensation + 1);
+}
+
+bool Mixer6Channels::isExpander(Module *other) {
+	return other && other->model == modelMixer6Expander;
+}
+
 void Mixer6::process(const ProcessArgs &args) {
 	// VCV Rack audio rate is +-5V
 	// VCV Rack CV is +-5V or 0V-10V
 	step++;
 
-	this->handleMuteButtons();
+	bool chainRight  = isExpander(rightExpander.module);
+	bool outputsLeft = leftExpander.module && leftExpander.module->model == modelMixer6Outputs;
+	MixerChainMessage *fromRight = (MixerChainMessage*) rightExpander.consumerMessage;
+	MixerChainMessage *fromLeft  = (MixerChainMessage*) leftExpander.consumerMessage;
 
-	float rate   = args.sampleRate;
+	if (step % control_rate == 1) {
+		this->handleMuteButtons();
+		soloChain = chainRight && fromRight->solo;
+		last = chainRight ? fromRight->last : 0;
+		for (int b = 1; b < num_busses; b++) {
+			busPatched[b] = outputsLeft && fromLeft->busPatched[b];
+		}
+		this->updateStrips(args.sampleRate);
 
-	float fx_send_A = 0;
-	float fx_send_B = 0;
+		float fxA = params[FX_A_TO_MAIN_PARAM].getValue();
+		float fxB = params[FX_B_TO_MAIN_PARAM].getValue();
+		returnGain = simd::float_4(fxA, fxA, fxB, fxB);
+		mainLevel  = params[LEVEL_MAIN].getValue();
+	}
 
-	float main_left  = 0;
-	float main_right = 0;
+	MixerSums sums;
+	float direct[MixerStrips<num_mono_channels>::GROUPS * 4];
+	this->processStrips(direct, sums);
+	this->compensate(sums, direct);
 
-	for (int ch = 0; ch < num_mono_channels; ch++) {
-		if (!inputs[INPUT+ch].isConnected() || mute_solo_state[ch] == -1 || (solo && mute_solo_state[ch] != 1)) {
-			continue;
+	// Expanders
+	if (chainRight) {
+		sums.add(fromRight->sums);
+
+		MixerChainMessage *toRight = (MixerChainMessage*) rightExpander.module->leftExpander.producerMessage;
+		toRight->solo = solo;
+		toRight->position = 1;
+		std::copy_n(busPatched, num_busses, toRight->busPatched);
+		toRight->stereoSends = stereoSends;
+		rightExpander.module->leftExpander.requestMessageFlip();
+	}
+
+	// Direct and subgroups
+	if (outputsLeft) {
+		MixerOutputMessage *toOutputs = (MixerOutputMessage*) leftExpander.module->rightExpander.producerMessage;
+		std::copy_n(direct, num_mono_channels, toOutputs->direct);
+		toOutputs->directChannels = std::min(num_mono_channels * (1 + (chainRight ? last : 0)), PORT_MAX_CHANNELS);
+		if (chainRight) {
+			std::copy(fromRight->direct + num_mono_channels, fromRight->direct + toOutputs->directChannels, toOutputs->direct + num_mono_channels);
 		}
-		float in = inputs[INPUT+ch].getVoltage();
-		float low    = params[LOW_PARAM+ch].getValue();
-		float mid    = params[MID_PARAM+ch].getValue();
-		float high   = params[HIGH_PARAM+ch].getValue();
-		
-		if (low != Pm || mid != Pm || high != Pm) {
-			float out1;
-			float out2;
-			float out3;
-
-			if (low != low_prev[ch] || mid != mid_prev[ch] || high != high_prev[ch] || rate != rate_prev) {
-				lowS[ch].setParameters(lowS[ch].LOWSHELF, c1/rate, Qs, low);
-				midP[ch].setParameters(midP[ch].PEAK, c2/rate, Qp, mid);
-				highS[ch].setParameters(highS[ch].HIGHSHELF, c3/rate, Qs, high);
-			}
-			low_prev[ch] = low;
-			mid_prev[ch] = mid;
-			high_prev[ch] = high;
-			out1 = lowS[ch].process(in);
-			out2 = midP[ch].process(in);
-			out3 = highS[ch].process(in);
-
-			if(std::isfinite(out1) && std::isfinite(out2) && std::isfinite(out3)) {
-				float out = (out1+out2+out3)/Gd;
-				fx_send_A += params[FX_A_SEND_PARAM+ch].getValue() * out;
-				fx_send_B += params[FX_B_SEND_PARAM+ch].getValue() * out;
-				main_left  += cos(params[PAN_PARAM+ch].getValue()) * params[CHANNEL_LEVEL_PARAM+ch].getValue() * out;
-				main_right += sin(params[PAN_PARAM+ch].getValue()) * params[CHANNEL_LEVEL_PARAM+ch].getValue() * out;
-			}
-		} else{
-			fx_send_A += params[FX_A_SEND_PARAM+ch].getValue() * in;
-			fx_send_B += params[FX_B_SEND_PARAM+ch].getValue() * in;
-			main_left  += cos(params[PAN_PARAM+ch].getValue()) * params[CHANNEL_LEVEL_PARAM+ch].getValue() * in;
-			main_right += sin(params[PAN_PARAM+ch].getValue()) * params[CHANNEL_LEVEL_PARAM+ch].getValue() * in;
+		std::copy_n(sums.left, num_busses, toOutputs->left);
+		std::copy_n(sums.right, num_busses, toOutputs->right);
+		leftExpander.module->rightExpander.requestMessageFlip();
+	}
+
+	// FX sends
+	for (int f = 0; f < num_sends; f++) {
+		if (stereoSends) {
+			outputs[FX_SEND_A+f].setChannels(2);
+			outputs[FX_SEND_A+f].setVoltage(sums.sendLeft[f], 0);
+			outputs[FX_SEND_A+f].setVoltage(sums.sendRight[f], 1);
+		} else {
+			outputs[FX_SEND_A+f].setChannels(1);
+			outputs[FX_SEND_A+f].setVoltage((sums.sendLeft[f] + sums.sendRight[f]) * 0.5f);
 		}
 	}
-	
-	// FX
-	outputs[FX_SEND_A].setVoltage(fx_send_A);
-	outputs[FX_SEND_B].setVoltage(fx_send_B);
-	float fx_return_left_A  = params[FX_A_TO_MAIN_PARAM].getValue() * inputs[FX_RETURN_L_A].getVoltage();
-	float fx_return_right_A = params[FX_A_TO_MAIN_PARAM].getValue() * inputs[FX_RETURN_R_A].getVoltage();
-	float fx_return_left_B  = params[FX_B_TO_MAIN_PARAM].getValue() * inputs[FX_RETURN_L_B].getVoltage();
-	float fx_return_right_B = params[FX_B_TO_MAIN_PARAM].getValue() * inputs[FX_RETURN_R_B].getVoltage();
-
-	// Main out
-	main_left  = fx_return_left_A  + fx_return_left_B  + main_left;
-	main_right = fx_return_right_A + fx_return_right_B + main_right;
-	main_left *= params[LEVEL_MAIN].getValue();
-	main_right *= params[LEVEL_MAIN].getValue();
-	outputs[MIXER_OUTPUT_L].setVoltage(main_left);
-	outputs[MIXER_OUTPUT_R].setVoltage(main_right);
-
-	rate_prev = rate;
-
-	// VU meters
-	vuMeterFXA_L.process(args.sampleTime, fx_return_left_A * 0.1f);
-	vuMeterFXA_R.process(args.sampleTime, fx_return_right_A * 0.1f);
-	vuMeterFXB_L.process(args.sampleTime, fx_return_left_B * 0.1f);
-	vuMeterFXB_R.process(args.sampleTime, fx_return_right_B * 0.1f);
-	vuMeterOut.process(args.sampleTime, main_left * 0.1f);
-	vuMeterOut2.process(args.sampleTime, main_right * 0.1f);
+
+	// Returns and main out, lanes are: A left, A right, B left, B right
+	simd::float_4 fx_return = returnGain * simd::float_4(inputs[FX_RETURN_L_A].getVoltage(), inputs[FX_RETURN_R_A].getVoltage(), inputs[FX_RETURN_L_B].getVoltage(), inputs[FX_RETURN_R_B].getVoltage());
+	simd::float_4 main = mainLevel * (simd::float_4(sums.left[0], sums.right[0], 0.0f, 0.0f) + fx_return + simd::float_4(fx_return[2], fx_return[3], 0.0f, 0.0f));
+	outputs[MIXER_OUTPUT_L].setVoltage(main[0]);
+	outputs[MIXER_OUTPUT_R].setVoltage(main[1]);
+
+	// VU meters, fed the peak of each control block
+	peakReturn = simd::fmax(peakReturn, simd::abs(fx_return));
+	peakMain   = simd::fmax(peakMain, simd::abs(main));
+	if (step % control_rate == 0) {
+		float deltaTime = args.sampleTime * control_rate;
+		vuMeterFXA_L.process(deltaTime, peakReturn[0] * 0.1f);
+		vuMeterFXA_R.process(deltaTime, peakReturn[1] * 0.1f);
+		vuMeterFXB_L.process(deltaTime, peakReturn[2] * 0.1f);
+		vuMeterFXB_R.process(deltaTime, peakReturn[3] * 0.1f);
+		vuMeterOut.process(deltaTime, peakMain[0] * 0.1f);
+		vuMeterOut2.process(deltaTime, peakMain[1] * 0.1f);
+		peakReturn = 0.0f;
+		peakMain   = 0.0f;
+	}
 	
 	for (int v = 0; step == 512 && v < 15; v++) {
 		if (v < 8) {
@@ -259,10 +700,133 @@ void Mixer6::process(const ProcessArgs &args) {
 	}
 }
 
-void Mixer6::handleMuteButtons() {
+void Mixer6Expander::process(const ProcessArgs &args) {
+	step++;
+
+	bool chainLeft  = leftExpander.module && (leftExpander.module->model == modelMixer6 || isExpander(leftExpander.module));
+	bool chainRight = isExpander(rightExpander.module);
+	MixerChainMessage *fromLeft  = (MixerChainMessage*) leftExpander.consumerMessage;
+	MixerChainMessage *fromRight = (MixerChainMessage*) rightExpander.consumerMessage;
+
+	if (step == 1) {
+		this->handleMuteButtons();
+		soloChain = (chainLeft && fromLeft->solo) || (chainRight && fromRight->solo);
+		for (int b = 1; b < num_busses; b++) {
+			busPatched[b] = chainLeft && fromLeft->busPatched[b];
+		}
+		stereoSends = chainLeft && fromLeft->stereoSends;
+		position = chainLeft ? fromLeft->position : 0;
+		last = chainRight ? fromRight->last : position;
+		this->updateStrips(args.sampleRate);
+	}
+	if (step == control_rate) {
+		step = 0;
+	}
+
+	if (!chainLeft) {
+		return;
+	}
+
+	float direct[MixerStrips<num_mono_channels>::GROUPS * 4];
+	MixerChainMessage *toLeft = (MixerChainMessage*) leftExpander.module->rightExpander.producerMessage;
+	this->processStrips(direct, toLeft->sums);
+	this->compensate(toLeft->sums, direct);
+	toLeft->solo = solo;
+	toLeft->last = last;
+	if (chainRight) {
+		std::copy_n(fromRight->direct, PORT_MAX_CHANNELS, toLeft->direct);
+	}
+	for (int ch = 0; ch < num_mono_channels && position * num_mono_channels + ch < PORT_MAX_CHANNELS; ch++) {
+		toLeft->direct[position * num_mono_channels + ch] = direct[ch];
+	}
+	if (chainRight) {
+		toLeft->sums.add(fromRight->sums);
+		toLeft->solo = solo || fromRight->solo;
+
+		MixerChainMessage *toRight = (MixerChainMessage*) rightExpander.module->leftExpander.producerMessage;
+		toRight->solo = solo || fromLeft->solo;
+		toRight->position = position + 1;
+		std::copy_n(busPatched, num_busses, toRight->busPatched);
+		toRight->stereoSends = stereoSends;
+		rightExpander.module->leftExpander.requestMessageFlip();
+	}
+	leftExpander.module->rightExpander.requestMessageFlip();
+}
+
+// Poly inputs get their voices summed, or spread out into left and right sums.
+void Mixer6Channels::processStrips(float* direct, MixerSums &sums) {
+	float inLeft[MixerStrips<num_mono_channels>::GROUPS * 4] = {};
+	float inRight[MixerStrips<num_mono_channels>::GROUPS * 4] = {};
+	for (int ch = 0; ch < num_mono_channels; ch++) {
+		int voices = inputs[INPUT+ch].getChannels();
+		simd::float_4 sumLeft  = 0.0f;
+		simd::float_4 sumRight = 0.0f;
+		for (int c = 0; c < voices; c += 4) {
+			simd::float_4 v = inputs[INPUT+ch].getVoltageSimd<simd::float_4>(c);
+			if (spread) {
+				sumLeft  += v * simd::float_4::load(&spreadLeft[voices][c]);
+				sumRight += v * simd::float_4::load(&spreadRight[voices][c]);
+			} else {
+				sumLeft  += v;
+			}
+		}
+		inLeft[ch]  = sumLeft[0]  + sumLeft[1]  + sumLeft[2]  + sumLeft[3];
+		inRight[ch] = sumRight[0] + sumRight[1] + sumRight[2] + sumRight[3];
+	}
+	if (spread) {
+		strips.process(inLeft, inRight, direct, sums);
+	} else {
+		strips.process(inLeft, direct, sums);
+	}
+}
+
+void Mixer6Outputs::process(const ProcessArgs &args) {
+	if (!rightExpander.module || rightExpander.module->model != modelMixer6) {
+		for (int o = 0; o < NUM_OUTPUTS; o++) {
+			outputs[o].setChannels(1);
+			outputs[o].setVoltage(0.0f);
+		}
+		return;
+	}
+	MixerOutputMessage *fromMixer = (MixerOutputMessage*) rightExpander.consumerMessage;
+
+	outputs[DIRECT_OUTPUT].setChannels(fromMixer->directChannels);
+	for (int c = 0; c < fromMixer->directChannels; c += 4) {
+		outputs[DIRECT_OUTPUT].setVoltageSimd(simd::float_4::load(fromMixer->direct + c), c);
+	}
+	for (int b = 1; b < num_busses; b++) {
+		outputs[SUBGROUP_1_OUTPUT+b-1].setChannels(2);
+		outputs[SUBGROUP_1_OUTPUT+b-1].setVoltage(fromMixer->left[b], 0);
+		outputs[SUBGROUP_1_OUTPUT+b-1].setVoltage(fromMixer->right[b], 1);
+	}
+
+	MixerChainMessage *toMixer = (MixerChainMessage*) rightExpander.module->leftExpander.producerMessage;
+	for (int b = 1; b < num_busses; b++) {
+		toMixer->busPatched[b] = outputs[SUBGROUP_1_OUTPUT+b-1].isConnected();
+	}
+	rightExpander.module->leftExpander.requestMessageFlip();
+}
+
+void Mixer6Channels::updateStrips(float rate) {
+	for (int ch = 0; ch < num_mono_channels; ch++) {
+		strips.setEQ(ch, params[LOW_PARAM+ch].getValue(), params[MID_PARAM+ch].getValue(), params[HIGH_PARAM+ch].getValue(), rate);
+		int toBus = busPatched[subgroup[ch]] ? subgroup[ch] : 0;
+		if (!inputs[INPUT+ch].isConnected() || mute_solo_state[ch] == -1 || ((solo || soloChain) && mute_solo_state[ch] != 1)) {
+			float send[num_sends] = {};
+			strips.setGains(ch, toBus, 0.0f, 0.0f, send, stereoSends);
+		} else {
+			float send[num_sends] = {params[FX_A_SEND_PARAM+ch].getValue(), params[FX_B_SEND_PARAM+ch].getValue()};
+			strips.setGains(ch, toBus, params[CHANNEL_LEVEL_PARAM+ch].getValue(), params[PAN_PARAM+ch].getValue(), send, stereoSends);
+		}
+	}
+	strips.rate_prev = rate;
+	strips.startRamp(control_rate);
+}
+
+void Mixer6Channels::handleMuteButtons() {
 	solo = false;
 	for (int ch = 0; ch < num_mono_channels; ch++) {
-		bool state = params[MUTE_BUTTON_PARAM+ch].getValue() >= 1.0f;
+		bool state = params[muteButtonParam+ch].getValue() >= 1.0f;
 		
 		if (state && !mute_solo_button_prev[ch]) {
 			mute_solo_state[ch] = mute_solo_state[ch] - 1;
@@ -272,21 +836,131 @@ void Mixer6::handleMuteButtons() {
 		}
 		if (mute_solo_state[ch] == 1) {
 			solo = true;
-			lights[MUTE_LIGHT+ch*3+0].setBrightness( 0.00f);
-			lights[MUTE_LIGHT+ch*3+2].setBrightness( 1.00f);
+			lights[muteLight+ch*3+0].setBrightness( 0.00f);
+			lights[muteLight+ch*3+2].setBrightness( 1.00f);
 		} else if (mute_solo_state[ch] == -1) {
-			lights[MUTE_LIGHT+ch*3+0].setBrightness( 1.00f);
-			lights[MUTE_LIGHT+ch*3+2].setBrightness( 0.00f);
+			lights[muteLight+ch*3+0].setBrightness( 1.00f);
+			lights[muteLight+ch*3+2].setBrightness( 0.00f);
 		} else {
-			lights[MUTE_LIGHT+ch*3+0].setBrightness( 0.00f);
-			lights[MUTE_LIGHT+ch*3+2].setBrightness( 0.00f);
+			lights[muteLight+ch*3+0].setBrightness( 0.00f);
+			lights[muteLight+ch*3+2].setBrightness( 0.00f);
 		}
 
 		mute_solo_button_prev[ch] = state;
 	}
 }
 
-struct Mixer6Widget : ModuleWidget {
+struct SpreadMenuItem : MenuItem {
+	Mixer6Channels* _module;
+	bool _spread;
+
+	SpreadMenuItem(Mixer6Channels* module, const char* label, bool spread)
+	: _module(module), _spread(spread)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->spread = _spread;
+	}
+
+	void step() override {
+		rightText = _module->spread == _spread ? "✔" : "";
+	}
+};
+
+struct SubgroupChoiceItem : MenuItem {
+	Mixer6Channels* _module;
+	int _channel;
+	int _subgroup;
+
+	SubgroupChoiceItem(Mixer6Channels* module, const char* label, int channel, int subgroup)
+	: _module(module), _channel(channel), _subgroup(subgroup)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->subgroup[_channel] = _subgroup;
+	}
+
+	void step() override {
+		rightText = _module->subgroup[_channel] == _subgroup ? "✔" : "";
+	}
+};
+
+struct SubgroupMenuItem : MenuItem {
+	Mixer6Channels* _module;
+	int _channel;
+
+	SubgroupMenuItem(Mixer6Channels* module, int channel)
+	: _module(module), _channel(channel)
+	{
+		this->text = "Channel "+std::to_string(channel+1)+" output";
+		this->rightText = RIGHT_ARROW;
+	}
+
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		menu->addChild(new SubgroupChoiceItem(_module, "Main", _channel, 0));
+		menu->addChild(new SubgroupChoiceItem(_module, "Subgroup 1", _channel, 1));
+		menu->addChild(new SubgroupChoiceItem(_module, "Subgroup 2", _channel, 2));
+		return menu;
+	}
+};
+
+struct Mixer6ChannelsWidget : ModuleWidget {
+	void addChannels(Mixer6Channels *module, int muteButtonParam, int muteLight);
+
+	void appendContextMenu(Menu* menu) override {
+		Mixer6Channels* a = dynamic_cast<Mixer6Channels*>(module);
+		assert(a);
+
+		menu->addChild(new MenuLabel());
+		menu->addChild(new SpreadMenuItem(a, "Poly inputs: Sum voices", false));
+		menu->addChild(new SpreadMenuItem(a, "Poly inputs: Spread voices in stereo", true));
+		menu->addChild(new MenuLabel());
+		for (int ch = 0; ch < num_mono_channels; ch++) {
+			menu->addChild(new SubgroupMenuItem(a, ch));
+		}
+	}
+};
+
+void Mixer6ChannelsWidget::addChannels(Mixer6Channels *module, int muteButtonParam, int muteLight) {
+	for (int ch = 0; ch < num_mono_channels; ch++) {
+		addInput(createInput<InPortAutinn>(        Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_PORT-RACK_GRID_WIDTH*2,        20), module, Mixer6Channels::INPUT+ch));
+		addParam(createParam<RoundSmallTyrkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2,  60), module, Mixer6Channels::HIGH_PARAM+ch));
+		addParam(createParam<RoundSmallTyrkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 100), module, Mixer6Channels::MID_PARAM+ch));
+		addParam(createParam<RoundSmallTyrkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 140), module, Mixer6Channels::LOW_PARAM+ch));
+		addParam(createParam<RoundSmallPinkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 190), module, Mixer6Channels::FX_A_SEND_PARAM+ch));
+		addParam(createParam<RoundSmallPinkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 230), module, Mixer6Channels::FX_B_SEND_PARAM+ch));
+		addParam(createParam<RoundSmallYelAutinnKnob>(Vec(  (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 280), module, Mixer6Channels::PAN_PARAM+ch));
+		addParam(createParam<RoundSmallAutinnKnob>(Vec(     (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 330), module, Mixer6Channels::CHANNEL_LEVEL_PARAM+ch));
+		addChild(createLight<MediumLight<RedGreenBlueLight>>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_LIGHT_MEDIUM-RACK_GRID_WIDTH*2, 270-HALF_LIGHT_MEDIUM), module, muteLight + ch*3));
+		addParam(createParam<RoundButtonSmallAutinn>(Vec(         (ch+1) * 4 * RACK_GRID_WIDTH-HALF_BUTTON_SMALL-RACK_GRID_WIDTH*0.5, 270-HALF_BUTTON_SMALL), module, muteButtonParam + ch));
+	}
+}
+
+struct StereoSendsMenuItem : MenuItem {
+	Mixer6* _module;
+	bool _stereo;
+
+	StereoSendsMenuItem(Mixer6* module, const char* label, bool stereo)
+	: _module(module), _stereo(stereo)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->stereoSends = _stereo;
+	}
+
+	void step() override {
+		rightText = _module->stereoSends == _stereo ? "✔" : "";
+	}
+};
+
+struct Mixer6Widget : Mixer6ChannelsWidget {
 	Mixer6Widget(Mixer6 *module) {
 		setModule(module);
 		int moduleWidth  = 32 * RACK_GRID_WIDTH;// height is 380
@@ -298,18 +972,7 @@ struct Mixer6Widget : ModuleWidget {
 		addChild(createWidget<ScrewStarAutinn>(Vec(moduleWidth - RACK_GRID_WIDTH*2, 0)));
 		addChild(createWidget<ScrewStarAutinn>(Vec(moduleWidth - RACK_GRID_WIDTH*2, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 
-		for (int ch = 0; ch < num_mono_channels; ch++) {
-			addInput(createInput<InPortAutinn>(        Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_PORT-RACK_GRID_WIDTH*2,        20), module, Mixer6::INPUT+ch));
-			addParam(createParam<RoundSmallTyrkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2,  60), module, Mixer6::HIGH_PARAM+ch));
-			addParam(createParam<RoundSmallTyrkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 100), module, Mixer6::MID_PARAM+ch));
-			addParam(createParam<RoundSmallTyrkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 140), module, Mixer6::LOW_PARAM+ch));
-			addParam(createParam<RoundSmallPinkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 190), module, Mixer6::FX_A_SEND_PARAM+ch));
-			addParam(createParam<RoundSmallPinkAutinnKnob>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 230), module, Mixer6::FX_B_SEND_PARAM+ch));
-			addParam(createParam<RoundSmallYelAutinnKnob>(Vec(  (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 280), module, Mixer6::PAN_PARAM+ch));
-			addParam(createParam<RoundSmallAutinnKnob>(Vec(     (ch+1) * 4 * RACK_GRID_WIDTH-HALF_KNOB_SMALL-RACK_GRID_WIDTH*2, 330), module, Mixer6::CHANNEL_LEVEL_PARAM+ch));
-			addChild(createLight<MediumLight<RedGreenBlueLight>>(Vec( (ch+1) * 4 * RACK_GRID_WIDTH-HALF_LIGHT_MEDIUM-RACK_GRID_WIDTH*2, 270-HALF_LIGHT_MEDIUM), module, Mixer6::MUTE_LIGHT + ch*3));
-			addParam(createParam<RoundButtonSmallAutinn>(Vec(         (ch+1) * 4 * RACK_GRID_WIDTH-HALF_BUTTON_SMALL-RACK_GRID_WIDTH*0.5, 270-HALF_BUTTON_SMALL), module, Mixer6::MUTE_BUTTON_PARAM + ch));
-		}
+		addChannels(module, Mixer6::MUTE_BUTTON_PARAM, Mixer6::MUTE_LIGHT);
 
 		// FX to Main knobs
 		float fx_to_main_x = moduleWidth*0.87;
@@ -377,6 +1040,53 @@ struct Mixer6Widget : ModuleWidget {
 			addChild(createLight<SmallLight<RedLight>>(Vec(light_x_pos_b + HALF_LIGHT_SMALL*2 - HALF_LIGHT_SMALL, light_y_pos - light_y_spacing * i), module, Mixer6::VU_FXB_RIGHT_LIGHT + i));
 		}
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Mixer6ChannelsWidget::appendContextMenu(menu);
+
+		Mixer6* a = dynamic_cast<Mixer6*>(module);
+		assert(a);
+
+		menu->addChild(new MenuLabel());
+		menu->addChild(new StereoSendsMenuItem(a, "FX sends: Mono", false));
+		menu->addChild(new StereoSendsMenuItem(a, "FX sends: Stereo (poly left and right)", true));
+	}
+};
+
+Model *modelMixer6 = createModel<Mixer6, Mixer6Widget>("Mixer6");
+
+struct Mixer6ExpanderWidget : Mixer6ChannelsWidget {
+	Mixer6ExpanderWidget(Mixer6Expander *module) {
+		setModule(module);
+		int moduleWidth  = 24 * RACK_GRID_WIDTH;// height is 380
+
+		setPanel(createPanel(asset::plugin(pluginInstance, "res/Mixer6ExpanderModule.svg")));
+
+		addChild(createWidget<ScrewStarAutinn>(Vec(RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewStarAutinn>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+		addChild(createWidget<ScrewStarAutinn>(Vec(moduleWidth - RACK_GRID_WIDTH*2, 0)));
+		addChild(createWidget<ScrewStarAutinn>(Vec(moduleWidth - RACK_GRID_WIDTH*2, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+
+		addChannels(module, Mixer6Expander::MUTE_BUTTON_PARAM, Mixer6Expander::MUTE_LIGHT);
+	}
+};
+
+Model *modelMixer6Expander = createModel<Mixer6Expander, Mixer6ExpanderWidget>("Mixer6Expander");
+
+struct Mixer6OutputsWidget : ModuleWidget {
+	Mixer6OutputsWidget(Mixer6Outputs *module) {
+		setModule(module);
+		setPanel(createPanel(asset::plugin(pluginInstance, "res/Mixer6OutputsModule.svg")));
+
+		addChild(createWidget<ScrewStarAutinn>(Vec(RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewStarAutinn>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewStarAutinn>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+		addChild(createWidget<ScrewStarAutinn>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+
+		addOutput(createOutput<OutPortAutinn>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_PORT, 100), module, Mixer6Outputs::DIRECT_OUTPUT));
+		addOutput(createOutput<OutPortAutinn>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_PORT, 200), module, Mixer6Outputs::SUBGROUP_1_OUTPUT));
+		addOutput(createOutput<OutPortAutinn>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_PORT, 250), module, Mixer6Outputs::SUBGROUP_2_OUTPUT));
+	}
 };
 
-Model *modelMixer6 = createModel<Mixer6, Mixer6Widget>("Mixer6");
\ No newline at end of file
+Model *modelMixer6Outputs = createModel<Mixer6Outputs, Mixer6OutputsWidget>("Mixer6Outputs");
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "Autinn.hpp"
 #include <cmath>
+#include <algorithm>
 
 /*
 
@@ -66,38 +67,77 @@ struct Nap : Module {
 		configLight(LOW_LIGHT, "Trying to fall asleep.. ");
 	}
 
-	float out_prev = 0.1f;
+	// up to 16 voices, 4 per SIMD lane group
+	simd::float_4 out_prev[4] = {0.1f, 0.1f, 0.1f, 0.1f};
+	simd::float_4 in_prev[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 
 	int current_oversample = 2;
+	int resamplerQuality = RESAMPLER_STANDARD;
+	bool trapezoidal = false;
 
-	dsp::Upsampler<oversample2, 10> upsampler2;
-	dsp::Decimator<oversample2, 10> decimator2;
-	dsp::Upsampler<oversample4, 10> upsampler4;
-	dsp::Decimator<oversample4, 10> decimator4;
+	Resampler<oversample2, 10, simd::float_4> resampler2[4];
+	Resampler<oversample4, 10, simd::float_4> resampler4[4];
 
 	json_t *dataToJson() override {
 		json_t *root = json_object();
 		json_object_set_new(root, "oversample", json_integer(current_oversample));
+		json_object_set_new(root, "trapezoidal", json_boolean(trapezoidal));
+		json_object_set_new(root, "resampler", json_integer(resamplerQuality));
 		return root;
 	}
 
 	void dataFromJson(json_t *rootJ) override {
 		json_t *ext3 = json_object_get(rootJ, "oversample");
 		if (ext3) {
-			current_oversample = json_integer_value(ext3);
-			if (current_oversample != 2 and current_oversample != 4) {
-				current_oversample = 4;
+			int os = json_integer_value(ext3);
+			if (os != 2 and os != 4) {
+				os = 4;
 			}
+			this->setOversample(os);
+		}
+		json_t *ext = json_object_get(rootJ, "trapezoidal");
+		if (ext) {
+			trapezoidal = json_boolean_value(ext);
+		}
+		json_t *ext4 = json_object_get(rootJ, "resampler");
+		if (ext4) {
+			this->setResamplerQuality(clamp((int) json_integer_value(ext4), 0, NUM_RESAMPLER_QUALITIES - 1));
 		}
 	}
 
 	void onReset(const ResetEvent& e) override {
-		current_oversample = 2;
+		this->setOversample(2);
+		trapezoidal = false;
+		this->setResamplerQuality(RESAMPLER_STANDARD);
 		Module::onReset(e);
 	}
 
-	float fwdEuler(float out_prev, float in);
-	float distort(float out_prev, float in);
+	template <int OVERSAMPLE>
+	simd::float_4 nap(int g, simd::float_4 pre, Resampler<OVERSAMPLE, 10, simd::float_4>& resampler);
+	simd::float_4 nap2(int g, simd::float_4 pre) {
+		return this->nap<oversample2>(g, pre, resampler2[g]);
+	}
+	simd::float_4 nap4(int g, simd::float_4 pre) {
+		return this->nap<oversample4>(g, pre, resampler4[g]);
+	}
+	simd::float_4 (Nap::*nap_func)(int g, simd::float_4 pre) = &Nap::nap2;// chosen once by setOversample() instead of every sample
+
+	void setOversample(int os) {
+		current_oversample = os;
+		nap_func = os == oversample4 ? &Nap::nap4 : &Nap::nap2;
+	}
+
+	void setResamplerQuality(int quality) {
+		resamplerQuality = quality;
+		for (int g = 0; g < 4; g++) {
+			resampler2[g].setQuality(quality);
+			resampler4[g].setQuality(quality);
+		}
+	}
+
+	simd::float_4 fwdEuler(simd::float_4 out_prev, simd::float_4 in);
+	simd::float_4 trapezoid(simd::float_4 out_prev, simd::float_4 in_prev, simd::float_4 in);
+	simd::float_4 distort(simd::float_4 out_prev, simd::float_4 in);
 	void process(const ProcessArgs &args) override;
 };
 
@@ -109,44 +149,65 @@ void Nap::process(const ProcessArgs &args) {
 		return;
 	}
 
-	float pre = inputs[NAP_INPUT].getVoltage() * (params[SNORING_PARAM].getValue() * (SNORING_MAX - SNORING_MIN) + SNORING_MIN);
+	int channels = std::max(1, inputs[NAP_INPUT].getChannels());
+	float snoring = params[SNORING_PARAM].getValue() * (SNORING_MAX - SNORING_MIN) + SNORING_MIN;
+	float pre_abs = 0.0f;
 
-	float inInter [current_oversample];
-	float outBuf  [current_oversample];
+	outputs[NAP_OUTPUT].setChannels(channels);
+	for (int c = 0; c < channels; c += 4) {
+		int g = c / 4;
+		simd::float_4 pre = inputs[NAP_INPUT].getVoltageSimd<simd::float_4>(c) * snoring;
 
-	if (current_oversample == oversample2) {
-		upsampler2.process(clamp(pre, -4.5f, 4.5f), inInter);
-	} else if (current_oversample == oversample4) {
-		upsampler4.process(clamp(pre, -4.5f, 4.5f), inInter);
-	}
+		simd::float_4 final = (this->*nap_func)(g, pre);
 
-	for (int i = 0; i < current_oversample; i++) {
-		float out = this->fwdEuler(out_prev, inInter[i]);
-		outBuf[i] = non_lin_func(out/12.0f);
-		out_prev = out;
-	}
-	float final;
-	if (current_oversample == oversample2) {
-		final = decimator2.process(outBuf);
-	} else {
-		final = decimator4.process(outBuf);
-	}
+		outputs[NAP_OUTPUT].setVoltageSimd(final*12.0f, c);
 
-	//outputs[NAP_OUTPUT].setChannels(2);
-    //outputs[NAP_OUTPUT].setVoltage(pre, 1);
-    outputs[NAP_OUTPUT].setVoltage(final*12.0f, 0);
+		// the lights show the hardest driven voice
+		for (int k = 0; k < 4 && c + k < channels; k++) {
+			pre_abs = std::max(pre_abs, std::fabs(pre[k]));
+		}
+	}
 
-    float pre_abs = fabs(pre);
 	lights[HIGH_LIGHT].value = fmax(0,(pre_abs-18.0f)*4.0f);
 	lights[MID_LIGHT].value = fmax(0,(pre_abs-4.5f)*2.0f);
 	lights[LOW_LIGHT].value = fmax(0,rescale(pre_abs, 0.0f, 4.5f, 1.0f, 0.0f));
 }
 
-float Nap::fwdEuler(float out_prv, float in) {
+template <int OVERSAMPLE>
+simd::float_4 Nap::nap(int g, simd::float_4 pre, Resampler<OVERSAMPLE, 10, simd::float_4>& resampler) {
+	simd::float_4 inInter [OVERSAMPLE];
+	simd::float_4 outBuf  [OVERSAMPLE];
+	resampler.upsample(simd::clamp(pre, -4.5f, 4.5f), inInter);
+
+	for (int i = 0; i < OVERSAMPLE; i++) {
+		simd::float_4 out;
+		if (trapezoidal) {
+			out = this->trapezoid(out_prev[g], in_prev[g], inInter[i]);
+		} else {
+			out = this->fwdEuler(out_prev[g], inInter[i]);
+		}
+		outBuf[i] = non_lin_func(out/12.0f);
+		out_prev[g] = out;
+		in_prev[g] = inInter[i];
+	}
+	return resampler.downsample(outBuf);
+}
+
+simd::float_4 Nap::fwdEuler(simd::float_4 out_prv, simd::float_4 in) {
     return out_prv + this->distort(out_prv, in)*params[DREAMING_PARAM].getValue();
 }
 
-float Nap::distort(float out_prv, float in) {
+// Trapezoidal rule, solved with a single Newton step from the previous output.
+// The Jacobian there is known in closed form, so the step costs one sinh and one cosh like Euler costs one sinh,
+// but the error is 2nd order and it stays stable for every dream amount.
+simd::float_4 Nap::trapezoid(simd::float_4 out_prv, simd::float_4 in_prv, simd::float_4 in) {
+	float h = params[DREAMING_PARAM].getValue();
+	simd::float_4 slope = this->distort(out_prv, in_prv) + (in - in_prv) / 44.0f;
+	simd::float_4 jacobian = 1.0f / 22.0f + 0.504f * 4.0f / 45.3f * cosh_fast(out_prv / 45.3f);
+	return out_prv + h * slope / (1.0f + 0.5f * h * jacobian);
+}
+
+simd::float_4 Nap::distort(simd::float_4 out_prv, simd::float_4 in) {
     return (in - out_prv) / 22.0f - 0.504f * non_lin_func2(out_prv / 45.3f);
 }
 
@@ -161,7 +222,7 @@ struct OversampleNapMenuItem : MenuItem {
 	}
 
 	void onAction(const event::Action &e) override {
-		_module->current_oversample = _os;
+		_module->setOversample(_os);
 	}
 
 	void step() override {
@@ -169,6 +230,25 @@ struct OversampleNapMenuItem : MenuItem {
 	}
 };
 
+struct SolverNapMenuItem : MenuItem {
+	Nap* _module;
+	bool _trapezoidal;
+
+	SolverNapMenuItem(Nap* module, const char* label, bool trapezoidal)
+	: _module(module), _trapezoidal(trapezoidal)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->trapezoidal = _trapezoidal;
+	}
+
+	void step() override {
+		rightText = _module->trapezoidal == _trapezoidal ? "✔" : "";
+	}
+};
+
 struct NapWidget : ModuleWidget {
 	NapWidget(Nap *module) {
 		setModule(module);
@@ -196,7 +276,11 @@ struct NapWidget : ModuleWidget {
 		
 		menu->addChild(new MenuLabel());
 		menu->addChild(new OversampleNapMenuItem(a, "Oversample x2", 2));
-		menu->addChild(new OversampleNapMenuItem(a, "Oversample x4", 4));		
+		menu->addChild(new OversampleNapMenuItem(a, "Oversample x4", 4));
+		appendResamplerMenu(menu, a);
+		menu->addChild(new MenuLabel());
+		menu->addChild(new SolverNapMenuItem(a, "Solver: Forward Euler", false));
+		menu->addChild(new SolverNapMenuItem(a, "Solver: Trapezoidal", true));
 	}
 };
 
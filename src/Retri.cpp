@@ -62,7 +62,7 @@ struct Flora : Module {
 	//float Boltzman = 0.000086173303f;// eV/K
 	//float t = 30.0f + 273.15f; // 30 celcius
 	//float V_t = 2.0f * t * Boltzman; // thermal voltage * 2 (should be divided by q also). Thermal V should be around 0.026V, times 2 its 0.052. Something divided by that gets multiplied by 19.23.
-	const float V_t = 2.0f * 0.026f;// more standard 2xthermalvoltage.
+	const float V_t = LADDER_V_T;// more standard 2xthermalvoltage.
 
 	float r = 0.0f;
 	float Gres = 1.0f;
@@ -71,61 +71,18 @@ struct Flora : Module {
 	float F_s = 0.0f;
 	float g = 0.0f; // tuning parameter
 	int current_oversample = 2;
+	int resamplerQuality = RESAMPLER_STANDARD;
 	float gComp = 0.0f;
 	bool autoLevel = false;// This adjusts the output gain to compensate for drive.
 	float F_c_prev = 0.0f;
 	float F_s_prev = 0.0f;
 
 	
-	//LEFT
+	// [0] is left, [1] is right
+	Ladder<float> ladder[2];
 	
-	float y_a = 0.0f;
-	float y_b = 0.0f;
-	float y_c = 0.0f;
-	float y_d = 0.0f;
-	float W_a = 0.0f;
-	float W_b = 0.0f;
-	float W_c = 0.0f;
-
-	float y_a_prev = 0.0f;
-	float y_b_prev = 0.0f;
-	float y_c_prev = 0.0f;
-	float y_d_prev = 0.0f;
-	float y_d_prev_prev = 0.0f;
-
-	float W_a_prev = 0.0f;
-	float W_b_prev = 0.0f;
-	float W_c_prev = 0.0f;
-	
-	dsp::Upsampler<oversample2, 10> upsampler2;
-	dsp::Decimator<oversample2, 10> decimator2;
-	dsp::Upsampler<oversample4, 10> upsampler4;
-	dsp::Decimator<oversample4, 10> decimator4;
-
-	// RIGHT
-	
-	float y_a_right = 0.0f;
-	float y_b_right = 0.0f;
-	float y_c_right = 0.0f;
-	float y_d_right = 0.0f;
-	float W_a_right = 0.0f;
-	float W_b_right = 0.0f;
-	float W_c_right = 0.0f;
-
-	float y_a_prev_right = 0.0f;
-	float y_b_prev_right = 0.0f;
-	float y_c_prev_right = 0.0f;
-	float y_d_prev_right = 0.0f;
-	float y_d_prev_prev_right = 0.0f;
-
-	float W_a_prev_right = 0.0f;
-	float W_b_prev_right = 0.0f;
-	float W_c_prev_right = 0.0f;
-	
-	dsp::Upsampler<oversample2, 10> upsampler2_right;
-	dsp::Decimator<oversample2, 10> decimator2_right;
-	dsp::Upsampler<oversample4, 10> upsampler4_right;
-	dsp::Decimator<oversample4, 10> decimator4_right;
+	Resampler<oversample2, 10, float> resampler2[2];
+	Resampler<oversample4, 10, float> resampler4[2];
 
 	
 
@@ -151,8 +108,28 @@ struct Flora : Module {
 	}
 
 	void process(const ProcessArgs &args) override;
-	void process_left(const ProcessArgs &args, int oversample_protected, float drive, float inv_drive);
-	void process_right(const ProcessArgs &args, int oversample_protected, float drive, float inv_drive);
+	template <int OVERSAMPLE>
+	float filter(Ladder<float>& ladder, Resampler<OVERSAMPLE, 10, float>& resampler, float in);
+	float filter2(int side, float in) {
+		return this->filter<oversample2>(ladder[side], resampler2[side], in);
+	}
+	float filter4(int side, float in) {
+		return this->filter<oversample4>(ladder[side], resampler4[side], in);
+	}
+	float (Flora::*filter_func)(int side, float in) = &Flora::filter2;// chosen once by setOversample() instead of every sample
+
+	void setOversample(int os) {
+		current_oversample = os;
+		filter_func = os == oversample4 ? &Flora::filter4 : &Flora::filter2;
+	}
+
+	void setResamplerQuality(int quality) {
+		resamplerQuality = quality;
+		for (int side = 0; side < 2; side++) {
+			resampler2[side].setQuality(quality);
+			resampler4[side].setQuality(quality);
+		}
+	}
 	float toExp(float x, float min, float max);
 	
 	json_t *dataToJson() override {
@@ -160,6 +137,7 @@ struct Flora : Module {
 		//json_object_set_new(root, "Gcomp", json_righteal((double) gComp));
 		json_object_set_new(root, "oversample", json_integer(current_oversample));
 		json_object_set_new(root, "autoLevel", json_boolean(autoLevel));
+		json_object_set_new(root, "resampler", json_integer(resamplerQuality));
 		return root;
 	}
 
@@ -172,17 +150,23 @@ struct Flora : Module {
 			autoLevel = json_boolean_value(ext2);
 		json_t *ext3 = json_object_get(rootJ, "oversample");
 		if (ext3) {
-			current_oversample = json_integer_value(ext3);
-			if (current_oversample != 2 and current_oversample != 4) {
-				current_oversample = 4;
+			int os = json_integer_value(ext3);
+			if (os != 2 and os != 4) {
+				os = 4;
 			}
+			this->setOversample(os);
+		}
+		json_t *ext4 = json_object_get(rootJ, "resampler");
+		if (ext4) {
+			this->setResamplerQuality(clamp((int) json_integer_value(ext4), 0, NUM_RESAMPLER_QUALITIES - 1));
 		}
 	}
 
 	void onReset(const ResetEvent& e) override {
 		gComp = 0.0f;
 		autoLevel = false;
-		current_oversample = 2;
+		this->setOversample(2);
+		this->setResamplerQuality(RESAMPLER_STANDARD);
 		Module::onReset(e);
 	}
 };
@@ -247,119 +231,31 @@ void Flora::process(const ProcessArgs &args) {
 	float inv_drive = VCV_TO_MOOG*INPUT_TO_CAPACITOR*((autoLevel && drive != 0.0f)?clamp(drive,0.10f,DRIVE_MAX):1.0f);
 	
 	if (outputs[FLORA_OUTPUT].isConnected()) {
-		this->process_left(args, oversample_protected, drive, inv_drive);
+		float in = inputs[FLORA_INPUT].getVoltage()*drive*VCV_TO_MOOG*INPUT_TO_CAPACITOR;
+		outputs[FLORA_OUTPUT].setVoltage((this->*filter_func)(0, in)/inv_drive);
 	}
 	
 	if (outputs[FLORA_OUTPUT2].isConnected()) {
-		this->process_right(args, oversample_protected, drive, inv_drive);
+		float in = inputs[FLORA_INPUT2].getVoltage()*drive*VCV_TO_MOOG*INPUT_TO_CAPACITOR;
+		outputs[FLORA_OUTPUT2].setVoltage((this->*filter_func)(1, in)/inv_drive);
 	}
 	
 	F_c_prev = F_c;
 	F_s_prev = F_s;
 }
 
-void Flora::process_left(const ProcessArgs &args, int oversample_protected, float drive, float inv_drive) {
-	float in = inputs[FLORA_INPUT].getVoltage()*drive*VCV_TO_MOOG*INPUT_TO_CAPACITOR;
-	float inInter [oversample_protected];
-	float outBuf  [oversample_protected];
-	if (oversample_protected == oversample2) {
-		upsampler2.process(in, inInter);
-	} else {
-		upsampler4.process(in, inInter);
-	}
-
-	for (int i = 0; i < oversample_protected; i++) {
-		// x is the voltage over the capacitor in the first stage:
-		float x   = inInter[i] - 2.0f*r*Gres*(y_d_prev+y_d_prev_prev);//unit and a half feedback delay to get phaseshift close to 180 deg at cutoff.
-		// -inInter[i]*Gcomp to make passband gain not decrease too much when turning up resonance. This was disabled due to lowered resonance power too much.
-		
-		// 1st transistor stage:
-		y_a = y_a_prev+g*(non_lin_func( x/V_t )-W_a_prev);
-		W_a = non_lin_func( y_a/V_t );
-		// 2nd transistor stage:
-		y_b = y_b_prev+g*(W_a-W_b_prev);
-		W_b = non_lin_func( y_b/V_t );
-		// 3rd transistor stage:
-		y_c = y_c_prev+g*(W_b-W_c_prev);
-		W_c = non_lin_func( y_c/V_t );
-		// 4th transistor stage:
-		y_d = y_d_prev+g*(W_c-non_lin_func( y_d_prev/V_t ));
-
-		// record stuff for next step
-		y_d_prev_prev = y_d_prev;
-		y_a_prev = y_a;
-		y_b_prev = y_b;
-		y_c_prev = y_c;
-		y_d_prev = y_d;
-
-		W_a_prev = W_a;
-		W_b_prev = W_b;
-		W_c_prev = W_c;
-		
-		outBuf[i] = y_d;
-	}
-	float out;
-	if (oversample_protected == oversample2) {
-		out = decimator2.process(outBuf);
-	} else {
-		out = decimator4.process(outBuf);
-	}
-	if(!std::isfinite(out)) {
-		out = 0.0f;
-	}
-	outputs[FLORA_OUTPUT].setVoltage(out/inv_drive);
-}
-
-void Flora::process_right(const ProcessArgs &args, int oversample_protected, float drive, float inv_drive) {
-	float in = inputs[FLORA_INPUT2].getVoltage()*drive*VCV_TO_MOOG*INPUT_TO_CAPACITOR;
-	float inInter [oversample_protected];
-	float outBuf  [oversample_protected];
-	if (oversample_protected == oversample2) {
-		upsampler2_right.process(in, inInter);
-	} else {
-		upsampler4_right.process(in, inInter);
-	}
-
-	for (int i = 0; i < oversample_protected; i++) {
-		// x is the voltage over the capacitor in the first stage:
-		float x   = inInter[i] - 2.0f*r*Gres*(y_d_prev_right+y_d_prev_prev_right);//unit and a half feedback delay to get phaseshift close to 180 deg at cutoff.
-		// -inInter[i]*Gcomp to make passband gain not decrease too much when turning up resonance. This was disabled due to lowered resonance power too much.
-		
-		// 1st transistor stage:
-		y_a_right = y_a_prev_right+g*(non_lin_func( x/V_t )-W_a_prev_right);
-		W_a_right = non_lin_func( y_a_right/V_t );
-		// 2nd transistor stage:
-		y_b_right = y_b_prev_right+g*(W_a_right-W_b_prev_right);
-		W_b_right = non_lin_func( y_b_right/V_t );
-		// 3rd transistor stage:
-		y_c_right = y_c_prev_right+g*(W_b_right-W_c_prev_right);
-		W_c_right = non_lin_func( y_c_right/V_t );
-		// 4th transistor stage:
-		y_d_right = y_d_prev_right+g*(W_c_right-non_lin_func( y_d_prev_right/V_t ));
-
-		// record stuff for next step
-		y_d_prev_prev_right = y_d_prev_right;
-		y_a_prev_right = y_a_right;
-		y_b_prev_right = y_b_right;
-		y_c_prev_right = y_c_right;
-		y_d_prev_right = y_d_right;
-
-		W_a_prev_right = W_a_right;
-		W_b_prev_right = W_b_right;
-		W_c_prev_right = W_c_right;
-		
-		outBuf[i] = y_d_right;
-	}
-	float out;
-	if (oversample_protected == oversample2) {
-		out = decimator2_right.process(outBuf);
-	} else {
-		out = decimator4_right.process(outBuf);
-	}
+template <int OVERSAMPLE>
+float Flora::filter(Ladder<float>& ladder, Resampler<OVERSAMPLE, 10, float>& resampler, float in) {
+	float inInter [OVERSAMPLE];
+	float outBuf  [OVERSAMPLE];
+	// -inInter[i]*Gcomp to make passband gain not decrease too much when turning up resonance. This was disabled due to lowered resonance power too much.
+	resampler.upsample(in, inInter);
+	ladder.process<OVERSAMPLE>(inInter, outBuf, g, g, 2.0f*r*Gres, 0.0f);
+	float out = resampler.downsample(outBuf);
 	if(!std::isfinite(out)) {
 		out = 0.0f;
 	}
-	outputs[FLORA_OUTPUT2].setVoltage(out/inv_drive);
+	return out;
 }
 
 /*struct EmphasizeMenuItem : MenuItem {
@@ -411,7 +307,7 @@ struct OversampleFloraMenuItem : MenuItem {
 	}
 
 	void onAction(const event::Action &e) override {
-		_module->current_oversample = _os;
+		_module->setOversample(_os);
 	}
 
 	void step() override {
@@ -461,6 +357,7 @@ struct FloraWidget : ModuleWidget {
 		menu->addChild(new MenuLabel());
 		menu->addChild(new OversampleFloraMenuItem(a, "Oversample x2", 2));
 		menu->addChild(new OversampleFloraMenuItem(a, "Oversample x4", 4));
+		appendResamplerMenu(menu, a);
 		menu->addChild(new MenuLabel());
 		menu->addChild(new AutoLevelMenuItem(a, "Auto level"));
 	}
@@ -23,7 +23,7 @@
 
 static const int oversample = 4;
 
-struct Saw : Module {
+struct Saw : ResampledModule<oversample, 8> {
 	enum ParamIds {
 		PITCH_PARAM,
 		NUM_PARAMS
@@ -241,8 +241,6 @@ struct Saw : Module {
 
 	float lowHigh [2] = {20.0f,100.0f};// use the low waveform at 20 hz, the high at 100 Hz.
 
-	dsp::Decimator<oversample, 8> decimator = dsp::Decimator<oversample, 8>(0.9f);
-	
 	Saw() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(Saw::PITCH_PARAM, -4.0f, 4.0f, 0.0f, "Frequency"," Hz", 2.0f, dsp::FREQ_C4);
@@ -252,6 +250,7 @@ struct Saw : Module {
 
 	float lut (int size, float in [], float out [], float test);
 	float range(float value, float valueRangeL, float valueRangeH, float rangeL, float rangeH);
+
 	void process(const ProcessArgs &args) override;
 };
 
@@ -327,7 +326,7 @@ void Saw::process(const ProcessArgs &args) {
 		}
 		outBuf[i] = out;
 	}
-	outputs[BUZZ_OUTPUT].setVoltage(decimator.process(outBuf) * 1.666f);// keep its peaks within approx +-5V.
+	outputs[BUZZ_OUTPUT].setVoltage(resampler[0].downsample(outBuf) * 1.666f);// keep its peaks within approx +-5V.
 
 	blinkTime += args.sampleTime;
 	float blinkPeriod = 1.0f/(freq*0.01f);
@@ -335,7 +334,7 @@ void Saw::process(const ProcessArgs &args) {
 	lights[BLINK_LIGHT].value = (blinkTime < blinkPeriod*0.5f) ? 1.0 : 0.0;
 }
 
-struct SawWidget : ModuleWidget {
+struct SawWidget : ResampledModuleWidget<Saw> {
 	SawWidget(Saw *module) {
 		setModule(module);
 		setPanel(createPanel(asset::plugin(pluginInstance, "res/SawModule.svg")));
@@ -23,7 +23,7 @@
 
 static const int oversample = 4;
 
-struct Square : Module {
+struct Square : ResampledModule<oversample, 8> {
 	enum ParamIds {
 		PITCH_PARAM,
 		NUM_PARAMS
@@ -44,8 +44,6 @@ struct Square : Module {
 	float phase = 0.0f;
 	float blinkTime = 0.0f;
 	
-	dsp::Decimator<oversample, 8> decimator = dsp::Decimator<oversample, 8>(0.9f);
-	
 	int szLow = 38;
 	int szHigh = 24;
 	float squareInLow[38] = {
@@ -195,6 +193,7 @@ struct Square : Module {
 
 	float lut (int size, float in [], float out [], float test);
 	float range(float value, float valueRangeL, float valueRangeH, float rangeL, float rangeH);
+
 	void process(const ProcessArgs &args) override;
 };
 
@@ -260,7 +259,7 @@ void Square::process(const ProcessArgs &args) {
 		//outBuf[i] = this->lut(2, lowHigh, lowHighValues, freq);
 		outBuf[i] = this->range(clamp(freq,lowHigh[0], lowHigh[1]), lowHigh[0], lowHigh[1], buzzL, buzzH);
 	}
-	outputs[BUZZ_OUTPUT].setVoltage(decimator.process(outBuf) * 5.0f);// keep its peaks within approx 5V.
+	outputs[BUZZ_OUTPUT].setVoltage(resampler[0].downsample(outBuf) * 5.0f);// keep its peaks within approx 5V.
 
 	blinkTime += args.sampleTime;
 	float blinkPeriod = 1.0f/(freq*0.01f);
@@ -268,7 +267,7 @@ void Square::process(const ProcessArgs &args) {
 	lights[BLINK_LIGHT].value = (blinkTime < blinkPeriod*0.5f) ? 1.0 : 0.0;
 }
 
-struct SquareWidget : ModuleWidget {
+struct SquareWidget : ResampledModuleWidget<Square> {
 	SquareWidget(Square *module) {
 		setModule(module);
 		setPanel(createPanel(asset::plugin(pluginInstance, "res/SquareModule.svg")));
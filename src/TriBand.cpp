@@ -1,5 +1,6 @@
 #include "Autinn.hpp"
 #include <cmath>
+#include <algorithm>
 
 /*
 
@@ -21,6 +22,8 @@
 
 **/
 
+const static int triband_control_rate = 32;// samples between reading knobs and CV
+
 struct TriBand : Module {
 	enum ParamIds {
 		LOW_PARAM,
@@ -30,6 +33,7 @@ struct TriBand : Module {
 	};
 	enum InputIds {
 		TRIBAND_INPUT,
+		CV_INPUT,
 		NUM_INPUTS
 	};
 	enum OutputIds {
@@ -40,9 +44,10 @@ struct TriBand : Module {
 		NUM_LIGHTS
 	};
 
-	dsp::BiquadFilter lowS;
-	dsp::BiquadFilter midP;
-	dsp::BiquadFilter highS;
+	// up to 16 voices, 4 per SIMD lane group
+	BiquadFilter4 lowS[4];
+	BiquadFilter4 midP[4];
+	BiquadFilter4 highS[4];
 
 	const float Gd = 30.0f;
 	const float Pm = 0.30f;
@@ -51,11 +56,14 @@ struct TriBand : Module {
 	const float c1 = 250.0f;
 	const float c2 = 700.0f;
 	const float c3 = 2000.0f;
+	const float cvScale = 3.0f;// 10V spans the knob range
 
 	float low_prev = -1;
 	float mid_prev = -1;
 	float high_prev = -1;
 	float rate_prev = -1;
+	int channels_prev = 0;
+	int step = 0;
 
 	TriBand() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -64,12 +72,34 @@ struct TriBand : Module {
 		configParam(TriBand::HIGH_PARAM, 0.5f, 100.0f*Pm, 100.0f*Pm, "High", " dB", 0.0f, 1.0f, -100.0f*Pm);
 		configBypass(TRIBAND_INPUT, TRIBAND_OUTPUT);
 		configInput(TRIBAND_INPUT, "Audio");
+		configInput(CV_INPUT, "Low, mid and high CV (channel 1, 2 and 3)");
 		configOutput(TRIBAND_OUTPUT, "Audio");
 	}
 
+	void updateCoefficients(int channels, float rate, bool force);
 	void process(const ProcessArgs &args) override;
 };
 
+// Control rate: the channels of the one CV input each move a band, the same for all voices.
+// Coefficients are only recomputed when the gains moved, or for new voices.
+void TriBand::updateCoefficients(int channels, float rate, bool force) {
+	float low  = clamp(params[LOW_PARAM].getValue()  + inputs[CV_INPUT].getVoltage(0) * cvScale, 0.5f, 100.0f*Pm);
+	float mid  = clamp(params[MID_PARAM].getValue()  + inputs[CV_INPUT].getVoltage(1) * cvScale, 0.5f, 100.0f*Pm);
+	float high = clamp(params[HIGH_PARAM].getValue() + inputs[CV_INPUT].getVoltage(2) * cvScale, 0.5f, 100.0f*Pm);
+
+	if (force || low != low_prev || mid != mid_prev || high != high_prev || rate != rate_prev) {
+		for (int c = 0; c < channels; c++) {
+			lowS[c / 4].setParameters(c % 4, dsp::BiquadFilter::LOWSHELF, c1/rate, Qs, low);
+			midP[c / 4].setParameters(c % 4, dsp::BiquadFilter::PEAK, c2/rate, Qp, mid);
+			highS[c / 4].setParameters(c % 4, dsp::BiquadFilter::HIGHSHELF, c3/rate, Qs, high);
+		}
+	}
+	low_prev = low;
+	mid_prev = mid;
+	high_prev = high;
+	rate_prev = rate;
+}
+
 void TriBand::process(const ProcessArgs &args) {
 	// VCV Rack audio rate is +-5V
 	// VCV Rack CV is +-5V or 0V-10V
@@ -77,34 +107,23 @@ void TriBand::process(const ProcessArgs &args) {
 	if (!outputs[TRIBAND_OUTPUT].isConnected()) {
 		return;
 	}
-	float in = inputs[TRIBAND_INPUT].getVoltage();
-	float low    = params[LOW_PARAM].getValue();
-	float mid    = params[MID_PARAM].getValue();
-	float high   = params[HIGH_PARAM].getValue();
-	float rate   = args.sampleRate;
-	float out1;
-	float out2;
-	float out3;
-
-	if (low != low_prev || mid != mid_prev || high != high_prev || rate != rate_prev) {
-		lowS.setParameters(lowS.LOWSHELF, c1/rate, Qs, low);
-		midP.setParameters(midP.PEAK, c2/rate, Qp, mid);
-		highS.setParameters(highS.HIGHSHELF, c3/rate, Qs, high);
+	int channels = std::max(1, inputs[TRIBAND_INPUT].getChannels());
+
+	step++;
+	if (step >= triband_control_rate || args.sampleRate != rate_prev || channels != channels_prev) {
+		// new voices get their coefficients before they are processed
+		step = 0;
+		this->updateCoefficients(channels, args.sampleRate, channels != channels_prev);
+		channels_prev = channels;
 	}
-	out1 = lowS.process(in);
-	out2 = midP.process(in);
-	out3 = highS.process(in);
-	if(!std::isfinite(out1) || !std::isfinite(out2) || !std::isfinite(out3)) {
-		out1 = 0.0f;
-		out2 = 0.0f;
-		out3 = 0.0f;
-	}
-	outputs[TRIBAND_OUTPUT].setVoltage((out1+out2+out3)/Gd);
 
-	low_prev = low;
-	mid_prev = mid;
-	high_prev = high;
-	rate_prev = rate;
+	outputs[TRIBAND_OUTPUT].setChannels(channels);
+	for (int c = 0; c < channels; c += 4) {
+		simd::float_4 in = inputs[TRIBAND_INPUT].getVoltageSimd<simd::float_4>(c);
+		simd::float_4 out = (lowS[c / 4].process(in) + midP[c / 4].process(in) + highS[c / 4].process(in)) / Gd;
+		out = simd::ifelse(simd::abs(out) < INFINITY, out, 0.0f);
+		outputs[TRIBAND_OUTPUT].setVoltageSimd(out, c);
+	}
 }
 
 struct TriBandWidget : ModuleWidget {
@@ -115,11 +134,12 @@ struct TriBandWidget : ModuleWidget {
 		addChild(createWidget<ScrewStarAutinn>(Vec(RACK_GRID_WIDTH, 0)));
 		addChild(createWidget<ScrewStarAutinn>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 
-		addParam(createParam<RoundMediumAutinnKnob>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_KNOB_MED, 185), module, TriBand::LOW_PARAM));
-		addParam(createParam<RoundMediumAutinnKnob>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_KNOB_MED, 130), module, TriBand::MID_PARAM));
-		addParam(createParam<RoundMediumAutinnKnob>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_KNOB_MED,  75), module, TriBand::HIGH_PARAM));
-		
-		addInput(createInput<InPortAutinn>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_PORT, 245), module, TriBand::TRIBAND_INPUT));
+		addParam(createParam<RoundMediumAutinnKnob>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_KNOB_MED, 153), module, TriBand::LOW_PARAM));
+		addParam(createParam<RoundMediumAutinnKnob>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_KNOB_MED, 101), module, TriBand::MID_PARAM));
+		addParam(createParam<RoundMediumAutinnKnob>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_KNOB_MED,  49), module, TriBand::HIGH_PARAM));
+
+		addInput(createInput<InPortAutinn>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_PORT, 206), module, TriBand::CV_INPUT));
+		addInput(createInput<InPortAutinn>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_PORT, 253), module, TriBand::TRIBAND_INPUT));
 		addOutput(createOutput<OutPortAutinn>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_PORT, 300), module, TriBand::TRIBAND_OUTPUT));
 	}
 };
@@ -46,6 +46,7 @@ struct VectorDriver : Module {
 	float angle = 0.0f;// degrees
 	bool firstRun = true;
 	float tim = 0.0f;
+	SeededRandom rng;
 
 	VectorDriver() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -54,6 +55,16 @@ struct VectorDriver : Module {
 		configOutput(Y_OUTPUT, "±5V Y CV");
 	}
 
+	json_t *dataToJson() override {
+		json_t *root = json_object();
+		json_object_set_new(root, "seed", rng.toJson());
+		return root;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		rng.fromJson(json_object_get(rootJ, "seed"));
+	}
+
 	void process(const ProcessArgs &args) override;
 };
 
@@ -66,15 +77,14 @@ void VectorDriver::process(const ProcessArgs &args) {
 	}
 	if (firstRun) {
 		firstRun = false;
-		srand (static_cast <unsigned> (time(0)));
-		float ran = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);// 0-1 random number
+		float ran = rng.uniform();// 0-1 random number
 		rotationSpeed = (ran*2-1.0f)*135.0f;
 	}
 	float dt = args.sampleTime;
 	float movementSpeed = params[SPEED_PARAM].getValue();// 2-5V/sec
 
 	if (tim > 2.5f) {
-		float r = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);// 0-1 random number
+		float r = rng.uniform();// 0-1 random number
 		rotationSpeed = (r*2-1.0f)*135*movementSpeed*0.2f;// +-135deg/s
 		tim = 0.0f;
 	}
@@ -1,8 +1,7 @@
 #include "Autinn.hpp"
 #include <cmath>
-#include <deque>
-
-using std::deque;
+#include <vector>
+#include <algorithm>
 
 /*
 
@@ -24,6 +23,8 @@ using std::deque;
 
 **/
 
+const static int vibrato_control_rate = 32;// samples between updating the LFO rotation
+
 struct Vibrato : Module {
 	enum ParamIds {
 		FREQ_PARAM,
@@ -43,6 +44,7 @@ struct Vibrato : Module {
 	};
 	enum OutputIds {
 		VIBRATO_OUTPUT,
+		RIGHT_OUTPUT,
 		NUM_OUTPUTS
 	};
 	enum LightIds {
@@ -63,120 +65,328 @@ struct Vibrato : Module {
 		configInput(FLANGER_INPUT, "Flanger CV");
 		configInput(VIBRATO_INPUT, "Audio");
 		configOutput(VIBRATO_OUTPUT, "Audio");
+		configOutput(RIGHT_OUTPUT, "Chorus right");
+
+		for (int g = 0; g < 16; g++) {
+			lfoSin[g] = 0.0f;
+			lfoCos[g] = 1.0f;
+			rotSin[g] = 0.0f;
+			rotCos[g] = 1.0f;
+		}
+		resizeBuffer(44100.0f);
+	}
+
+	// Delay line: one ring per group of 4 voices, time runs along the vector and voices across the lanes.
+	// Sized to a power of two on sample rate change, so the audio path never allocates.
+	std::vector<simd::float_4> buffer[4];
+	int bufferMask = 0;
+	int writeIndex = 0;
+
+	// Recursive sine LFO: each voice rotates its own (sin, cos) pair.
+	// Vibrato mode uses the first 4 as voice groups, chorus mode uses one per voice with a tap in each lane.
+	simd::float_4 lfoSin[16];
+	simd::float_4 lfoCos[16];
+	simd::float_4 rotSin[16];
+	simd::float_4 rotCos[16];
+
+	// Chorus mode: taps spread from left to right, unused lanes have no gain.
+	simd::float_4 tapLeft = 0.0f;
+	simd::float_4 tapRight = 0.0f;
+
+	bool spreadPhases = true;
+	bool spread_prev = true;
+	int taps = 1;// 1 is vibrato, 2-4 is stereo chorus
+	int taps_prev = 1;
+	bool right_prev = false;
+	int channels_prev = 0;
+	float rate_prev = -1;
+	int step = 0;
+
+	void onReset(const ResetEvent& e) override {
+		spreadPhases = true;
+		taps = 1;
+		Module::onReset(e);
 	}
 
-	float phase = 0.0f;
-	float out_prev = 0.0f;
-	deque <float> buffer;
-	//deque <float> median;
+	void onSampleRateChange(const SampleRateChangeEvent& e) override {
+		resizeBuffer(e.sampleRate);
+	}
+
+	json_t *dataToJson() override {
+		json_t *root = json_object();
+		json_object_set_new(root, "spreadPhases", json_boolean(spreadPhases));
+		json_object_set_new(root, "taps", json_integer(taps));
+		return root;
+	}
 
-	//float lastValue = 0.0f;
+	void dataFromJson(json_t *root) override {
+		json_t *ext = json_object_get(root, "spreadPhases");
+		if (ext) {
+			spreadPhases = json_boolean_value(ext);
+		}
+		json_t *ext_taps = json_object_get(root, "taps");
+		if (ext_taps) {
+			taps = clamp((int) json_integer_value(ext_taps), 1, 4);
+		}
+	}
 
 	void process(const ProcessArgs &args) override;
-	//float slew(float value);
-	int sign(float x);
+	void resizeBuffer(float rate);
+	void seedLFO(int channels);
+	void updateLFO(int channels, float sampleTime);
+	void updateTapGains(bool stereo);
+	simd::float_4 readSpline(int group, simd::float_4 tapper);
+	simd::float_4 readTaps(int voice, simd::float_4 tapper);
+	void processVibrato(int channels, float rate);
+	void processChorus(int channels, float rate);
 };
 
+void Vibrato::resizeBuffer(float rate) {
+	// the tap reaches at most 4+2*width samples back, width is max 20ms.
+	int size = 1;
+	while (size < 8 + int(0.040f * rate)) {
+		size *= 2;
+	}
+	for (int g = 0; g < 4; g++) {
+		buffer[g].assign(size, simd::float_4(0.0f));
+	}
+	bufferMask = size - 1;
+	writeIndex = 0;
+}
+
+// Places every voice on the circle at the phase of voice 1 plus its offset, that keeps the LFO continuous when voices are added.
+// In chorus mode the taps of a voice are further spread evenly around the circle.
+void Vibrato::seedLFO(int channels) {
+	float phase = atan2(lfoSin[0][0], lfoCos[0][0]);
+	for (int c = 0; c < 16; c++) {
+		float offset = spreadPhases ? 2.0f * M_PI * c / channels : 0.0f;
+		if (taps == 1) {
+			lfoSin[c / 4][c % 4] = sin(phase + offset);
+			lfoCos[c / 4][c % 4] = cos(phase + offset);
+		} else {
+			for (int k = 0; k < 4; k++) {
+				lfoSin[c][k] = sin(phase + offset + 2.0f * M_PI * k / taps);
+				lfoCos[c][k] = cos(phase + offset + 2.0f * M_PI * k / taps);
+			}
+		}
+	}
+}
+
+// Control rate: the rotation per sample follows the frequency of each voice, and the pairs are pulled back onto the unit circle.
+void Vibrato::updateLFO(int channels, float sampleTime) {
+	for (int c = 0; c < channels; c++) {
+		float freq = clamp(params[FREQ_PARAM].getValue()+params[CV_FREQ_PARAM].getValue()*inputs[FREQ_INPUT].getPolyVoltage(c)*19.0f, 1.0f,20.0f);//Hz
+		float deltaPhase = freq * sampleTime * 2.0f*M_PI;
+		if (taps == 1) {
+			rotSin[c / 4][c % 4] = sin(deltaPhase);
+			rotCos[c / 4][c % 4] = cos(deltaPhase);
+		} else {
+			rotSin[c] = sin(deltaPhase);
+			rotCos[c] = cos(deltaPhase);
+		}
+	}
+	for (int g = 0; g < 16; g++) {
+		simd::float_4 norm = 1.0f / simd::sqrt(lfoSin[g] * lfoSin[g] + lfoCos[g] * lfoCos[g]);
+		lfoSin[g] *= norm;
+		lfoCos[g] *= norm;
+	}
+}
+
+// Equal power panning of the taps from left to right, each side sums to unity for a dry signal.
+// Without a right cable all taps are mixed to the left output.
+void Vibrato::updateTapGains(bool stereo) {
+	tapLeft = 0.0f;
+	tapRight = 0.0f;
+	float sumLeft = 0.0f;
+	float sumRight = 0.0f;
+	for (int k = 0; k < taps; k++) {
+		float pan = stereo ? 0.5f * M_PI * k / (taps - 1) : 0.0f;
+		tapLeft[k] = stereo ? cos(pan) : 1.0f;
+		tapRight[k] = sin(pan);
+		sumLeft += tapLeft[k];
+		sumRight += tapRight[k];
+	}
+	tapLeft *= 1.0f / sumLeft;
+	if (stereo) {
+		tapRight *= 1.0f / sumRight;
+	}
+}
+
+// 3rd order B-spline between the 4 samples around the tap, weights in Horner form.
+inline simd::float_4 bSpline(simd::float_4 line, simd::float_4 line_m1, simd::float_4 line_m2, simd::float_4 line_m3, simd::float_4 portion) {
+	simd::float_4 rest = 1.0f - portion;
+	simd::float_4 w   = portion * portion * portion;
+	simd::float_4 wm1 = 1.0f + portion * (3.0f + portion * (3.0f - 3.0f * portion));
+	simd::float_4 wm2 = 4.0f + portion * portion * (3.0f * portion - 6.0f);
+	simd::float_4 wm3 = rest * rest * rest;
+	return (line * w + line_m1 * wm1 + line_m2 * wm2 + line_m3 * wm3) * (1.0f / 6.0f);
+}
+
+// Each lane reads the tap of its own voice.
+simd::float_4 Vibrato::readSpline(int group, simd::float_4 tapper) {
+	simd::float_4 index = simd::floor(tapper);
+	simd::float_4 line, line_m1, line_m2, line_m3;
+	const std::vector<simd::float_4>& ring = buffer[group];
+	for (int k = 0; k < 4; k++) {
+		int i = writeIndex - int(index[k]);
+		line[k]    = ring[ i      & bufferMask][k];
+		line_m1[k] = ring[(i + 1) & bufferMask][k];
+		line_m2[k] = ring[(i + 2) & bufferMask][k];
+		line_m3[k] = ring[(i + 3) & bufferMask][k];
+	}
+	return bSpline(line, line_m1, line_m2, line_m3, tapper - index);
+}
+
+// All lanes read taps from the same voice.
+simd::float_4 Vibrato::readTaps(int voice, simd::float_4 tapper) {
+	simd::float_4 index = simd::floor(tapper);
+	simd::float_4 line, line_m1, line_m2, line_m3;
+	const std::vector<simd::float_4>& ring = buffer[voice / 4];
+	int lane = voice % 4;
+	for (int k = 0; k < 4; k++) {
+		int i = writeIndex - int(index[k]);
+		line[k]    = ring[ i      & bufferMask][lane];
+		line_m1[k] = ring[(i + 1) & bufferMask][lane];
+		line_m2[k] = ring[(i + 2) & bufferMask][lane];
+		line_m3[k] = ring[(i + 3) & bufferMask][lane];
+	}
+	return bSpline(line, line_m1, line_m2, line_m3, tapper - index);
+}
+
 void Vibrato::process(const ProcessArgs &args) {
 	// VCV Rack audio rate is +-5V
 	// VCV Rack CV is +-5V or 0V-10V
 
-	if (!outputs[VIBRATO_OUTPUT].isConnected()) {
+	if (!outputs[VIBRATO_OUTPUT].isConnected() && !outputs[RIGHT_OUTPUT].isConnected()) {
 		return;
 	}
-	float in = inputs[VIBRATO_INPUT].getVoltage();
-
-	float freq    = clamp(params[FREQ_PARAM].getValue()+params[CV_FREQ_PARAM].getValue()*inputs[FREQ_INPUT].getVoltage()*19.0f, 1.0f,20.0f);//Hz
-	float width   = clamp(params[WIDTH_PARAM].getValue()+params[CV_WIDTH_PARAM].getValue()*inputs[WIDTH_INPUT].getVoltage()*0.019f, 0.001f,0.020f);//ms
-	float flanger = clamp(params[FLANGER_PARAM].getValue()+params[CV_FLANGER_PARAM].getValue()*inputs[FLANGER_INPUT].getVoltage(), 0.0f,1.0f);//ratio
 	float rate = args.sampleRate;
-	float width_samples = width*rate; // samples
-	float delay_samples = width_samples; // samples
 	if (rate == 0.0f) {
 		outputs[VIBRATO_OUTPUT].setVoltage(0.0f);
+		outputs[RIGHT_OUTPUT].setVoltage(0.0f);
 		return;
 	}
-	//int bufferSize = 4+delay_samples+width_samples*2;// max going to be 11524
-	int bufferSize_max = 12000;//a little larger than max, then we dont have to shrink it when dialing knobs or changing rate.
-
-	float period = 2.0f*M_PI;
-	float deltaPhase = freq * args.sampleTime * period;
-	phase += deltaPhase;
-	phase = fmod(phase, period);
-
-	float modulationFactor = sin(phase);
-	float tapper = 4.0f+delay_samples+width_samples*modulationFactor;//1 changed to 4 to give room for spline.
-	int i = floor(tapper);
-	float portion=tapper-i;
-	buffer.push_front(in);
-
-	while (int(buffer.size()) > bufferSize_max) {
-		buffer.pop_back();
-	}
-	float line    = 0.0f;
-	float line_m1 = 0.0f;
-	float line_m2 = 0.0f;
-	float line_m3 = 0.0f;
-	if (int(buffer.size()) >= i-2 && i-3 >= 0) {
-		line_m3 = buffer[i-3];
-	}
-	if (int(buffer.size()) >= i-1 && i-2 >= 0) {
-		line_m2 = buffer[i-2];
-	}
-	if (int(buffer.size()) >= i && i-1 >= 0) {
-		line_m1 = buffer[i-1];
-	}
-	if (int(buffer.size()) > i && i >= 0) {
-		line = buffer[i];
-	}
-	//linear
-	//float out=line*portion+line_m1*(1.0f-portion);
-	//allpass
-	//float out = (line+(1.0f-portion)*line_m1-(1.0f-portion)*out_prev);
-	//out_prev=out;
-	//Spline		
-	float out = line*pow(portion,3.0f)/6.0f+line_m1*(pow(1.0f+portion,3.0f)-4.0f*pow(portion,3.0f))/6.0f+line_m2*(pow(2.0f-portion,3.0f)-4.0f*pow(1.0f-portion,3.0f))/6.0f+line_m3*pow(1.0f-portion,3.0f)/6.0f;// order: 3rd 
-	/*
-	median.push_front(out);
-	
-
-	if (median.size() == 4) {
-		// this is a declicker (moving median filter with window of size 3)
-		out = median.back();
-		median.pop_back();
-		float v1 = median[0];
-		float v2 = median[1];
-		float v3 = median[2];
-		if (fabs(v2-v1) > 0.001 and fabs(v2-v3) > 0.001) {// and this->sign(v2-v1) == this->sign(v2-v3)) {
-			median[1] = (v1+v3)*0.5f;
+	int channels = std::max(1, inputs[VIBRATO_INPUT].getChannels());
+	bool right = outputs[RIGHT_OUTPUT].isConnected();
+
+	if (channels != channels_prev || spreadPhases != spread_prev || taps != taps_prev) {
+		this->seedLFO(channels);
+		if (taps != taps_prev) {
+			// the rotations are laid out differently in the two modes
+			step = vibrato_control_rate;
 		}
+		channels_prev = channels;
+		spread_prev = spreadPhases;
+		taps_prev = taps;
+		right_prev = !right;
+	}
+	if (right != right_prev) {
+		this->updateTapGains(right);
+		right_prev = right;
+	}
+	step++;
+	if (step >= vibrato_control_rate || rate != rate_prev) {
+		step = 0;
+		this->updateLFO(channels, args.sampleTime);
+	}
+	rate_prev = rate;
+
+	writeIndex = (writeIndex + 1) & bufferMask;
+
+	outputs[VIBRATO_OUTPUT].setChannels(channels);
+	outputs[RIGHT_OUTPUT].setChannels(channels);
+	if (taps == 1) {
+		this->processVibrato(channels, rate);
 	} else {
-		out = 0.0f;
-	}**/
+		this->processChorus(channels, rate);
+	}
+}
+
+void Vibrato::processVibrato(int channels, float rate) {
+	for (int c = 0; c < channels; c += 4) {
+		int g = c / 4;
+		simd::float_4 in = inputs[VIBRATO_INPUT].getVoltageSimd<simd::float_4>(c);
+		buffer[g][writeIndex] = in;
+
+		simd::float_4 width   = simd::clamp(params[WIDTH_PARAM].getValue()+params[CV_WIDTH_PARAM].getValue()*inputs[WIDTH_INPUT].getPolyVoltageSimd<simd::float_4>(c)*0.019f, 0.001f,0.020f);//ms
+		simd::float_4 flanger = simd::clamp(params[FLANGER_PARAM].getValue()+params[CV_FLANGER_PARAM].getValue()*inputs[FLANGER_INPUT].getPolyVoltageSimd<simd::float_4>(c), 0.0f,1.0f);//ratio
+		simd::float_4 width_samples = width*rate; // samples
+		simd::float_4 delay_samples = width_samples; // samples
+
+		simd::float_4 modulationFactor = lfoSin[g] * rotCos[g] + lfoCos[g] * rotSin[g];
+		lfoCos[g] = lfoCos[g] * rotCos[g] - lfoSin[g] * rotSin[g];
+		lfoSin[g] = modulationFactor;
+
+		simd::float_4 tapper = 4.0f+delay_samples+width_samples*modulationFactor;//1 changed to 4 to give room for spline.
+		simd::float_4 out = this->readSpline(g, tapper)+in*flanger;
 
-	outputs[VIBRATO_OUTPUT].setVoltage(out+in*flanger);//this->slew(out+in*params[FLANGER_PARAM].getValue());
+		outputs[VIBRATO_OUTPUT].setVoltageSimd(out, c);
+		outputs[RIGHT_OUTPUT].setVoltageSimd(out, c);
+	}
 }
 
-int Vibrato::sign (float x) {
-	if (x > 0.0f) return 1;
-	if (x < 0.0f) return -1;
-	return 0;
+// Each voice runs its taps as the lanes of one SIMD vector, so 4 taps cost the same as 1.
+void Vibrato::processChorus(int channels, float rate) {
+	for (int c = 0; c < channels; c += 4) {
+		buffer[c / 4][writeIndex] = inputs[VIBRATO_INPUT].getVoltageSimd<simd::float_4>(c);
+	}
+	for (int c = 0; c < channels; c++) {
+		float in      = inputs[VIBRATO_INPUT].getVoltage(c);
+		float width   = clamp(params[WIDTH_PARAM].getValue()+params[CV_WIDTH_PARAM].getValue()*inputs[WIDTH_INPUT].getPolyVoltage(c)*0.019f, 0.001f,0.020f);//ms
+		float flanger = clamp(params[FLANGER_PARAM].getValue()+params[CV_FLANGER_PARAM].getValue()*inputs[FLANGER_INPUT].getPolyVoltage(c), 0.0f,1.0f);//ratio
+		float width_samples = width*rate; // samples
+
+		simd::float_4 modulationFactor = lfoSin[c] * rotCos[c] + lfoCos[c] * rotSin[c];
+		lfoCos[c] = lfoCos[c] * rotCos[c] - lfoSin[c] * rotSin[c];
+		lfoSin[c] = modulationFactor;
+
+		simd::float_4 tapper = 4.0f+width_samples+width_samples*modulationFactor;
+		simd::float_4 out = this->readTaps(c, tapper);
+		simd::float_4 left = out * tapLeft;
+		simd::float_4 right = out * tapRight;
+
+		outputs[VIBRATO_OUTPUT].setVoltage(left[0]+left[1]+left[2]+left[3]+in*flanger, c);
+		outputs[RIGHT_OUTPUT].setVoltage(right[0]+right[1]+right[2]+right[3]+in*flanger, c);
+	}
 }
 
-/*
-float Vibrato::slew(float value) {//linear slew to prevent static noise when turning width knob.
-	float max_change = 12/0.003;//12V per 0.003s = 4000V/sec
-	float change = value - lastValue;
-	float change_per_sec = fabs(change)/args.sampleTime;
-	float factor = 1.0f;
+struct VibratoSpreadMenuItem : MenuItem {
+	Vibrato* _module;
+	bool _spread;
+
+	VibratoSpreadMenuItem(Vibrato* module, const char* label, bool spread)
+	: _module(module), _spread(spread)
+	{
+		this->text = label;
+	}
 
-	if (change_per_sec>max_change and change_per_sec != 0.0f) {
-		factor = max_change/change_per_sec;
+	void onAction(const event::Action &e) override {
+		_module->spreadPhases = _spread;
 	}
-	float newValue = lastValue+change*factor;
-	lastValue = newValue;
-	return newValue;
-}**/
+
+	void step() override {
+		rightText = _module->spreadPhases == _spread ? "✔" : "";
+	}
+};
+
+struct VibratoTapsMenuItem : MenuItem {
+	Vibrato* _module;
+	int _taps;
+
+	VibratoTapsMenuItem(Vibrato* module, const char* label, int taps)
+	: _module(module), _taps(taps)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->taps = _taps;
+	}
+
+	void step() override {
+		rightText = _module->taps == _taps ? "✔" : "";
+	}
+};
 
 struct VibratoWidget : ModuleWidget {
 	VibratoWidget(Vibrato *module) {
@@ -203,6 +413,21 @@ struct VibratoWidget : ModuleWidget {
 
 		addInput(createInput<InPortAutinn>(Vec(3 * RACK_GRID_WIDTH*0.5-HALF_PORT, 300), module, Vibrato::VIBRATO_INPUT));
 		addOutput(createOutput<OutPortAutinn>(Vec(7.5 * RACK_GRID_WIDTH-HALF_PORT, 300), module, Vibrato::VIBRATO_OUTPUT));
+		addOutput(createOutput<OutPortAutinn>(Vec(4.5 * RACK_GRID_WIDTH-HALF_PORT, 300), module, Vibrato::RIGHT_OUTPUT));
+	}
+
+	void appendContextMenu(Menu *menu) override {
+		Vibrato *a = dynamic_cast<Vibrato*>(module);
+		assert(a);
+
+		menu->addChild(new MenuLabel());
+		menu->addChild(new VibratoTapsMenuItem(a, "Mode: Vibrato", 1));
+		menu->addChild(new VibratoTapsMenuItem(a, "Mode: Stereo chorus, 2 taps", 2));
+		menu->addChild(new VibratoTapsMenuItem(a, "Mode: Stereo chorus, 3 taps", 3));
+		menu->addChild(new VibratoTapsMenuItem(a, "Mode: Stereo chorus, 4 taps", 4));
+		menu->addChild(new MenuLabel());
+		menu->addChild(new VibratoSpreadMenuItem(a, "Poly LFO: Same phase for all voices", false));
+		menu->addChild(new VibratoSpreadMenuItem(a, "Poly LFO: Spread phases over voices", true));
 	}
 };
 
@@ -1,8 +1,10 @@
 #include "Autinn.hpp"
 #include <cmath>
 #include <queue>
+#include <vector>
 
 using std::queue;
+using std::vector;
 /*
 
     Autinn VCV Rack Plugin
@@ -44,6 +46,7 @@ using std::queue;
 #define KNEE_MAX_DB                      10.0
 #define KNEE_DEFAULT_DB                   5.0
 #define MAKEUP_GAIN_MAX                  10.0//20dB
+#define LATENCY_MS_PER_VOLT             100.0// latency CV scale, 350ms lookahead is 3.5V
 
 struct Zod : Module {
 	enum ParamIds {
@@ -76,6 +79,9 @@ struct Zod : Module {
 		LEFT_OUTPUT,
 		RIGHT_OUTPUT,
 		//DB,
+		DRY_LEFT_OUTPUT,
+		DRY_RIGHT_OUTPUT,
+		LATENCY_OUTPUT,
 		NUM_OUTPUTS
 	};
 	enum LightIds {
@@ -105,6 +111,15 @@ struct Zod : Module {
 	queue <float> bufferL;
 	queue <float> bufferR;
 
+	// sliding window RMS (exact window of D samples):
+	bool slidingRMS = false;
+	vector <double> window;
+	unsigned windowSize = 0;
+	unsigned windowIndex = 0;
+	double windowSum = 0.0;
+	double windowSumFresh = 0.0;
+	bool windowStale = true;
+
 	// these are here to optimize so not to do expensive ops every step:
 	double ta = -150.0;
 	double tap = -150.0;
@@ -159,6 +174,9 @@ struct Zod : Module {
 		configInput(RIGHT_INPUT, "Right audio");
 		configOutput(LEFT_OUTPUT, "Left audio");
 		configOutput(RIGHT_OUTPUT, "Right audio");
+		configOutput(DRY_LEFT_OUTPUT, "Left audio delayed by lookahead (dry)");
+		configOutput(DRY_RIGHT_OUTPUT, "Right audio delayed by lookahead (dry)");
+		configOutput(LATENCY_OUTPUT, "Lookahead latency (1V per 100ms)");
 
 		configInput(SIDE_LEFT_INPUT, "Sidechain audio left");
 		configInput(SIDE_RIGHT_INPUT, "Sidechain audio right");
@@ -171,11 +189,31 @@ struct Zod : Module {
 		configBypass(RIGHT_INPUT, RIGHT_OUTPUT);
 	}
 
+	json_t *dataToJson() override {
+		json_t *root = json_object();
+		json_object_set_new(root, "slidingRMS", json_boolean(slidingRMS));
+		return root;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		json_t *ext = json_object_get(rootJ, "slidingRMS");
+		if (ext) {
+			slidingRMS = json_boolean_value(ext);
+		}
+	}
+
+	void onReset(const ResetEvent& e) override {
+		slidingRMS = false;
+		Module::onReset(e);
+	}
+
 	double toDB(double volt);
 	double toGain(double dB);
 	double smooth(double k, double g_prev, double f);
 	double peak(double x, double ATp, double RT);
 	double rms(double x);
+	double rmsWindow(double x);
+	void resizeWindow(unsigned size);
 	double staticCurve(double rms, double peak, double LT, double LS, double CS, double CT, double CR, 
 					   double NT, double ET, double ES, double ER, double knee);
 	double toExp10(double x, double min, double max);
@@ -286,7 +324,7 @@ void Zod::process(const ProcessArgs &args) {
 	// VCV Rack audio rate is +-5V
 	// VCV Rack CV is +-5V or 0V-10V
 
-	if (!outputs[LEFT_OUTPUT].isConnected() && !outputs[RIGHT_OUTPUT].isConnected()) {
+	if (!outputs[LEFT_OUTPUT].isConnected() && !outputs[RIGHT_OUTPUT].isConnected() && !outputs[DRY_LEFT_OUTPUT].isConnected() && !outputs[DRY_RIGHT_OUTPUT].isConnected() && !outputs[LATENCY_OUTPUT].isConnected()) {
 		return;
 	}
 	step++;
@@ -320,6 +358,10 @@ void Zod::process(const ProcessArgs &args) {
 	double TS = args.sampleTime * 1000.0; //ms
 
 	if (taKnob != params[ATTACK_PARAM].getValue() || tapKnob != params[ATTACK_PEAK_PARAM].getValue() || trKnob != params[RELEASE_PARAM].getValue() || erKnob != params[RATIO_EXPANDER_PARAM].getValue() || crKnob != params[RATIO_COMPRESSOR_PARAM].getValue() || rate != args.sampleRate || tavKnob != params[AVERAGE_TIME_PARAM].getValue() || gainKnob != params[OUT_GAIN_PARAM].getValue()) {
+		if (rate != args.sampleRate) {
+			// allocate for the longest window once per samplerate, so turning the knob never allocates:
+			window.reserve((unsigned)(args.sampleRate * RMS_TIME_HIGH_MS * 0.001) + 1);
+		}
 		rate = args.sampleRate;
 		tavKnob = params[AVERAGE_TIME_PARAM].getValue();
 		D   = (unsigned)(rate * tavKnob * 0.001);
@@ -344,6 +386,10 @@ void Zod::process(const ProcessArgs &args) {
 
 		double t_M = TS * D;
 		TAV = 1.0 - exp(-2.2 * TS / t_M);
+
+		if (D != windowSize) {
+			this->resizeWindow(D);
+		}
 	}
 
 	unsigned hyst_max = HYSTERESIS_TIME_SEC / args.sampleTime;
@@ -375,7 +421,18 @@ void Zod::process(const ProcessArgs &args) {
 
 	// level measurement:
 	double peak = this->peak(stereo, ATp, RT);
-	double rms  = this->rms(stereo);
+	double rms;
+	if (slidingRMS) {
+		if (windowStale) {
+			// window was not fed while the exponential average was in use:
+			this->resizeWindow(windowSize);
+			windowStale = false;
+		}
+		rms = this->rmsWindow(stereo);
+	} else {
+		rms = this->rms(stereo);
+		windowStale = true;
+	}
 
 	// static curve:
 	double f = this->staticCurve(rms, peak, LT, LS, CS, CT, CR, NT, ET, ES, ER, knee);
@@ -421,6 +478,7 @@ void Zod::process(const ProcessArgs &args) {
 		peak_prev = 1.0;
 		peak = 1.0;
 		rms2_prev = 1.0;
+		this->resizeWindow(windowSize);
 		g_prev = 1.0;
 		f_prev = 1.0;
 		g = 1.0;
@@ -433,6 +491,11 @@ void Zod::process(const ProcessArgs &args) {
 	outR = non_lin_func(outR / 12.0f) * 12.0f;
 	outputs[RIGHT_OUTPUT].setVoltage(outR);
 
+	// dry signal and latency, for keeping parallel chains phase aligned:
+	outputs[DRY_LEFT_OUTPUT].setVoltage(pastL);
+	outputs[DRY_RIGHT_OUTPUT].setVoltage(pastR);
+	outputs[LATENCY_OUTPUT].setVoltage((float) (1000.0 * D / rate / LATENCY_MS_PER_VOLT));
+
 
 	// VU meters
 	vuMeterIn.process(args.sampleTime, pastL * 0.1f);
@@ -519,6 +582,33 @@ double Zod::rms(double x) {
 	return rms2;
 }
 
+double Zod::rmsWindow(double x) {
+	// Exact mean of x^2 over the last windowSize samples. O(1) per sample.
+	// The running sum would drift by float error, so a second sum is started fresh each time
+	// the index wraps, at which point it covers exactly the whole window and replaces the running sum.
+	double x2 = x * x;
+	windowSum += x2 - window[windowIndex];
+	windowSumFresh += x2;
+	window[windowIndex] = x2;
+	windowIndex++;
+	if (windowIndex >= windowSize) {
+		windowIndex = 0;
+		windowSum = windowSumFresh;
+		windowSumFresh = 0.0;
+	}
+	rms2_prev = fmax(windowSum, 0.0) / windowSize;
+	return rms2_prev;
+}
+
+void Zod::resizeWindow(unsigned size) {
+	// Fill the new window with the current estimate, so changing its length does not make the detector drop out.
+	windowSize = size > 0 ? size : 1;
+	window.assign(windowSize, rms2_prev);
+	windowIndex = 0;
+	windowSum = rms2_prev * windowSize;
+	windowSumFresh = 0.0;
+}
+
 double Zod::peak(double x, double ATp, double RT) {
 	double xAbs = fabs(x);
 	if (xAbs > peak_prev) {
@@ -539,6 +629,39 @@ double Zod::toGain(double dB) {
 	return pow(10.0, (dB / 20.0)); //I don't multiply with 5v here as its a ratio.
 }
 
+struct SlidingRMSMenuItem : MenuItem {
+	Zod* _module;
+	bool _sliding;
+
+	SlidingRMSMenuItem(Zod* module, const char* label, bool sliding)
+	: _module(module), _sliding(sliding)
+	{
+		this->text = label;
+	}
+
+	void onAction(const event::Action &e) override {
+		_module->slidingRMS = _sliding;
+	}
+
+	void step() override {
+		rightText = _module->slidingRMS == _sliding ? "✔" : "";
+	}
+};
+
+struct LatencyZodMenuLabel : MenuLabel {
+	Zod* _module;
+
+	LatencyZodMenuLabel(Zod* module)
+	: _module(module)
+	{
+	}
+
+	void step() override {
+		text = string::f("Latency: %u samples (%.2f ms)", _module->D, _module->rate > 0.0 ? 1000.0 * _module->D / _module->rate : 0.0);
+		MenuLabel::step();
+	}
+};
+
 struct ZodWidget : ModuleWidget {
 	ZodWidget(Zod *module) {
 		setModule(module);
@@ -570,6 +693,9 @@ struct ZodWidget : ModuleWidget {
 		addOutput(createOutput<OutPortAutinn>(Vec(16 * RACK_GRID_WIDTH * 0.15 - HALF_PORT, 275), module, Zod::LEFT_OUTPUT));
 		addOutput(createOutput<OutPortAutinn>(Vec(16 * RACK_GRID_WIDTH * 0.30 - HALF_PORT, 275), module, Zod::RIGHT_OUTPUT));
 		//addOutput(createOutput<OutPortAutinn>(Vec(16 * RACK_GRID_WIDTH*0.75-HALF_PORT, 75), module, Zod::DB));
+		addOutput(createOutput<OutPortAutinn>(Vec(16 * RACK_GRID_WIDTH * 0.66 - HALF_PORT, 14), module, Zod::DRY_LEFT_OUTPUT));
+		addOutput(createOutput<OutPortAutinn>(Vec(16 * RACK_GRID_WIDTH * 0.80 - HALF_PORT, 14), module, Zod::DRY_RIGHT_OUTPUT));
+		addOutput(createOutput<OutPortAutinn>(Vec(16 * RACK_GRID_WIDTH * 0.35 - HALF_PORT, 14), module, Zod::LATENCY_OUTPUT));
 		addInput(createInput<InPortAutinn>(Vec(16 * RACK_GRID_WIDTH * 0.55 - HALF_PORT, 305), module, Zod::N_INPUT));
 		addInput(createInput<InPortAutinn>(Vec(16 * RACK_GRID_WIDTH * 0.65 - HALF_PORT, 305), module, Zod::E_INPUT));
 		addInput(createInput<InPortAutinn>(Vec(16 * RACK_GRID_WIDTH * 0.75 - HALF_PORT, 305), module, Zod::C_INPUT));
@@ -607,6 +733,17 @@ struct ZodWidget : ModuleWidget {
 			addChild(createLight<SmallLight<RedLight>>(Vec(16 * RACK_GRID_WIDTH * light_x_pos - HALF_LIGHT_SMALL + light_column_dist + HALF_LIGHT_SMALL * 2.0f, light_y_pos - light_y_spacing * i), module, Zod::VU_OUT_RIGHT_LIGHT + i));
 		}
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Zod* a = dynamic_cast<Zod*>(module);
+		assert(a);
+
+		menu->addChild(new MenuLabel());
+		menu->addChild(new LatencyZodMenuLabel(a));
+		menu->addChild(new MenuLabel());
+		menu->addChild(new SlidingRMSMenuItem(a, "Average: Exponential", false));
+		menu->addChild(new SlidingRMSMenuItem(a, "Average: Sliding window", true));
+	}
 };
 
 Model *modelZod = createModel<Zod, ZodWidget>("Zod");